@@ -0,0 +1,73 @@
+/*
+    uLZ benchmark and corpus generator shared by tools and tests
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#ifndef _ULZBENCH_H
+#define _ULZBENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// One piece of benchmark data
+typedef struct
+{
+    /// Data name, for the report
+    const char *name;
+    /// The data
+    uint8_t *data;
+    /// Data size
+    unsigned size;
+} bench_data_t;
+
+/// Number of pieces in the synthetic corpus
+#define BENCH_CORPUS_SIZE       5
+
+/// Benchmark settings
+typedef struct
+{
+    /// Compression level, may be OR'ed with ULZ_FLAG_XXX
+    unsigned level;
+    /// Match finder memory, bytes
+    unsigned workmem;
+    /// Decompress plain blocks with ulz_decompress_fast() instead of ulz_decompress()
+    bool fast;
+    /// Repeat every measurement for at least this many milliseconds
+    unsigned min_time;
+    /// Number of truncated or corrupt blocks fed to the decompressor, per piece
+    unsigned fuzz;
+} bench_opts_t;
+
+/**
+ * Generate the synthetic corpus: text, binary tables, ARM Thumb code,
+ * random data and zeros. The data is same on every run and every host,
+ * so results may be compared before and after a change.
+ *
+ * @param corpus Receives BENCH_CORPUS_SIZE pieces of data,
+ *      to be freed with bench_corpus_free() even on failure
+ * @return false if there's not enough memory
+ */
+extern bool bench_corpus (bench_data_t *corpus);
+
+/**
+ * Free the data allocated by bench_corpus().
+ */
+extern void bench_corpus_free (bench_data_t *corpus);
+
+/**
+ * Compress and decompress every piece of data as a single block, checking
+ * that data survives the round trip, and report compression ratio and speed.
+ * Then feed the decompressor with truncated and corrupt blocks; it may
+ * output garbage, but must not write outside the output buffer.
+ *
+ * @param data Data to benchmark
+ * @param count Number of pieces of data
+ * @param opts Benchmark settings
+ * @return false if any check failed, or there's not enough memory
+ */
+extern bool bench (const bench_data_t *data, unsigned count, const bench_opts_t *opts);
+
+#endif // _ULZBENCH_H
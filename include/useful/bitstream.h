@@ -130,4 +130,374 @@ EXTERN_C bool bs_write_bits (bitstream_t *bs, unsigned bits, uint32_t val);
  */
 EXTERN_C unsigned bs_write_finish (bitstream_t *bs, void *buff, unsigned size);
 
+// -------------------------------------------------------------------------- //
+
+/*
+ * A faster reader and writer for the same bitstream format. Bits go
+ * through a reservoir as wide as CPU registers, which is loaded and stored
+ * by whole words, so a field costs a shift and a mask instead of a loop
+ * over bytes. Bits may be looked at before they are consumed, which is
+ * handy for table-driven decoders.
+ *
+ * They also support a forward single-stream format: bits go forward
+ * from the start of buffer, starting from the lowest bit of every byte,
+ * and whole bytes are put in between at byte boundaries. This needs no
+ * compaction when writing is done, so the output may be streamed.
+ */
+
+#if __UINTPTR_MAX__ == __UINT64_MAX__
+/// Bit reservoir type
+typedef uint64_t br_acc_t;
+#  define __br_bswap(x)		__builtin_bswap64 (x)
+#else
+typedef uint32_t br_acc_t;
+#  define __br_bswap(x)		bswap32 (x)
+#endif
+
+/// Number of bits in the reservoir
+#define BR_ACC_BITS		(sizeof (br_acc_t) * 8)
+/// Max number of bits that can be peeked or read at once: 24 or 56
+#define BR_PEEK_MAX		(BR_ACC_BITS - 8)
+
+/**
+ * Fast bitstream reader state.
+ */
+typedef struct
+{
+    /// Byte substream pointer, or next byte in forward format
+    const uint8_t *ptr;
+    /// Bit substream pointer (moves down), or end of data in forward format
+    const uint8_t *end;
+    /// Bit reservoir, next bit is bit 0
+    br_acc_t acc;
+    /// Number of valid bits in reservoir
+    unsigned acc_bits;
+    /// Data is in forward single-stream format
+    bool forward;
+    /// Set to true if a read past end of data is attempted
+    bool exhausted;
+} bitreader_t;
+
+/// Unaligned reservoir-sized word
+typedef struct { br_acc_t v; } PACKED __br_word_t;
+
+/**
+ * Initialize a fast reader for data written with bs_write_bits()
+ * and bs_write_bytes().
+ *
+ * @param br Bitstream reader
+ * @param buff Bitstream data
+ * @param size Bitstream data size
+ */
+EXTERN_C void br_init (bitreader_t *br, const void *buff, unsigned size);
+
+/**
+ * Initialize a fast reader for data written by a forward bitwriter_t.
+ *
+ * @param br Bitstream reader
+ * @param buff Bitstream data
+ * @param size Bitstream data size
+ */
+EXTERN_C void br_init_fwd (bitreader_t *br, const void *buff, unsigned size);
+
+/**
+ * Make sure there are at least BR_PEEK_MAX bits in the reservoir,
+ * unless the bit substream ends earlier.
+ *
+ * @param br Bitstream reader
+ */
+INLINE_ALWAYS void br_refill (bitreader_t *br)
+{
+    if (br->end - br->ptr >= (int)sizeof (br_acc_t))
+    {
+        // load a whole word, but count only bytes that fit completely;
+        // bits above acc_bits are the next ones and will be loaded again
+        unsigned n = (BR_ACC_BITS - 1 - br->acc_bits) >> 3;
+        br_acc_t w;
+        if (br->forward)
+        {
+            w = ((const __br_word_t *)br->ptr)->v;
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+            w = __br_bswap (w);
+#endif
+            br->ptr += n;
+        }
+        else
+        {
+            // bit substream goes down, so its next byte is the last one in word
+            w = ((const __br_word_t *)(br->end - sizeof (br_acc_t)))->v;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            w = __br_bswap (w);
+#endif
+            br->end -= n;
+        }
+        br->acc |= w << br->acc_bits;
+        br->acc_bits |= BR_ACC_BITS - 8;
+    }
+    else
+        while ((br->acc_bits < BR_ACC_BITS - 8) && (br->end > br->ptr))
+        {
+            br->acc |= (br_acc_t)(br->forward ? *br->ptr++ : *(--br->end)) << br->acc_bits;
+            br->acc_bits += 8;
+        }
+}
+
+/**
+ * Look at next bits of the bit substream without consuming them.
+ * Bits past end of data are undefined.
+ *
+ * @param br Bitstream reader
+ * @param bits Number of bits to look at (must be <= BR_PEEK_MAX!)
+ * @return the bits
+ */
+INLINE_ALWAYS br_acc_t br_peek_bits (bitreader_t *br, unsigned bits)
+{
+    if (br->acc_bits < bits)
+        br_refill (br);
+    return br->acc & (((br_acc_t)1 << bits) - 1);
+}
+
+/**
+ * Consume bits which were looked at with br_peek_bits().
+ * If this goes past end of data, br->exhausted is set to true.
+ *
+ * @param br Bitstream reader
+ * @param bits Number of bits to skip (must be <= bits peeked)
+ */
+INLINE_ALWAYS void br_skip_bits (bitreader_t *br, unsigned bits)
+{
+    if (bits > br->acc_bits)
+    {
+        br->exhausted = true;
+        bits = br->acc_bits;
+    }
+    br->acc >>= bits;
+    br->acc_bits -= bits;
+}
+
+/**
+ * Read bits from the bit substream, same as bs_read_bits().
+ * If a read past end of buffer is attempted, br->exhausted is set to true.
+ *
+ * @param br Bitstream reader
+ * @param bits Number of bits to read (must be <= BR_PEEK_MAX!)
+ * @return the bits read
+ */
+INLINE_ALWAYS br_acc_t br_read_bits (bitreader_t *br, unsigned bits)
+{
+    br_acc_t val = br_peek_bits (br, bits);
+    br_skip_bits (br, bits);
+    return val;
+}
+
+/**
+ * Return the number of bytes left for the byte substream,
+ * or the number of whole bytes left in forward format.
+ *
+ * @param br Bitstream reader
+ */
+INLINE_ALWAYS unsigned br_avail (bitreader_t *br)
+{
+    // whole bytes in reservoir were loaded ahead of time
+    return br->end + (br->acc_bits >> 3) - br->ptr;
+}
+
+/**
+ * Skip bytes of the byte substream, e.g. after they were read directly
+ * from br->ptr. The caller must check br_avail() first.
+ * Not for the forward format, use br_read_bytes() there.
+ *
+ * @param br Bitstream reader
+ * @param size Number of bytes to skip
+ */
+INLINE_ALWAYS void br_skip_bytes (bitreader_t *br, unsigned size)
+{
+    br->ptr += size;
+    if (br->ptr > br->end)
+    {
+        // bytes loaded into reservoir ahead of time are not bits anymore
+        br->acc_bits -= (br->ptr - br->end) * 8;
+        br->acc &= ((br_acc_t)1 << br->acc_bits) - 1;
+        br->end = br->ptr;
+    }
+}
+
+/**
+ * Read whole bytes from the byte substream, same as bs_read_bytes().
+ * In forward format the rest of current byte is skipped first.
+ *
+ * @param br Bitstream reader
+ * @param dst A pointer to destination buffer
+ * @param size Number of bytes to read
+ * @return false if bitstream is exhausted
+ */
+EXTERN_C bool br_read_bytes (bitreader_t *br, void *dst, unsigned size);
+
+// -------------------------------------------------------------------------- //
+
+/**
+ * A callback used by a forward bitstream writer to output the filled buffer.
+ *
+ * @param ctx User-defined context
+ * @param data A pointer to output data
+ * @param size Data size
+ * @return false to abort writing
+ */
+typedef bool (*bw_output_t) (void *ctx, const void *data, unsigned size);
+
+/**
+ * Fast bitstream writer state.
+ */
+typedef struct
+{
+    /// Start of output buffer
+    uint8_t *start;
+    /// Output buffer size
+    unsigned size;
+    /// Byte substream pointer, or next byte in forward format
+    uint8_t *ptr;
+    /// Bit substream pointer (moves down), or end of buffer in forward format
+    uint8_t *end;
+    /// Bit reservoir, next bit goes above acc_bits
+    br_acc_t acc;
+    /// Number of bits in reservoir, always less than BR_ACC_BITS
+    unsigned acc_bits;
+    /// Number of bytes passed to output callback so far
+    unsigned done;
+    /// Output callback in forward format, or NULL
+    bw_output_t output;
+    /// Output callback context
+    void *ctx;
+    /// Data goes in forward single-stream format
+    bool forward;
+    /// Set to true if data does not fit into the output buffer
+    bool exhausted;
+} bitwriter_t;
+
+/**
+ * Initialize a fast writer. Output is same as from bs_write_bits()
+ * and bs_write_bytes(), and can be read by both bitstream_t and bitreader_t.
+ *
+ * @param bw Bitstream writer
+ * @param buff Destination buffer
+ * @param size Destination buffer size
+ */
+EXTERN_C void bw_init (bitwriter_t *bw, void *buff, unsigned size);
+
+/**
+ * Initialize a fast writer in forward single-stream format, to be read
+ * with br_init_fwd().
+ *
+ * @param bw Bitstream writer
+ * @param buff Destination buffer, at least sizeof (br_acc_t) bytes
+ *      if @a output is used
+ * @param size Destination buffer size
+ * @param output If not NULL, this is called every time buffer fills up,
+ *      so that data of any size may be written through a small buffer
+ * @param ctx Output callback context
+ */
+EXTERN_C void bw_init_fwd (bitwriter_t *bw, void *buff, unsigned size,
+                           bw_output_t output, void *ctx);
+
+/// Store whole bytes from reservoir when there's less than a word of room left
+EXTERN_C bool __bw_flush_slow (bitwriter_t *bw);
+
+/// Store whole bytes from reservoir
+INLINE_ALWAYS bool __bw_flush (bitwriter_t *bw)
+{
+    if (bw->end - bw->ptr < (int)sizeof (br_acc_t))
+        return __bw_flush_slow (bw);
+
+    // store a whole word, but count only bytes that are complete
+    unsigned n = bw->acc_bits >> 3;
+    br_acc_t w = bw->acc;
+    if (bw->forward)
+    {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+        w = __br_bswap (w);
+#endif
+        ((__br_word_t *)bw->ptr)->v = w;
+        bw->ptr += n;
+    }
+    else
+    {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        w = __br_bswap (w);
+#endif
+        ((__br_word_t *)(bw->end - sizeof (br_acc_t)))->v = w;
+        bw->end -= n;
+    }
+
+    bw->acc >>= n * 8;
+    bw->acc_bits &= 7;
+    return true;
+}
+
+/**
+ * Write bits to the bit substream.
+ *
+ * @param bw Bitstream writer
+ * @param bits Number of bits to write (must be <= 32!)
+ * @param val The bits to be written (starting from lower bits);
+ *      bits above @a bits must be zero
+ * @return false if data does not fit into the output buffer
+ */
+INLINE_ALWAYS bool bw_write_bits (bitwriter_t *bw, unsigned bits, uint32_t val)
+{
+    if (bw->acc_bits + bits >= BR_ACC_BITS)
+    {
+        if (!__bw_flush (bw))
+            return false;
+
+        // 32-bit reservoir may still lack room for a long field
+        if (bw->acc_bits + bits >= BR_ACC_BITS)
+        {
+            bw->acc |= (br_acc_t)(val & 0xFFFF) << bw->acc_bits;
+            bw->acc_bits += 16;
+            val >>= 16;
+            bits -= 16;
+            if (!__bw_flush (bw))
+                return false;
+        }
+    }
+
+    bw->acc |= (br_acc_t)val << bw->acc_bits;
+    bw->acc_bits += bits;
+    return true;
+}
+
+/**
+ * Write many fields to the bit substream at once.
+ *
+ * @param bw Bitstream writer
+ * @param vals Field values, see bw_write_bits()
+ * @param widths Field widths in bits, every one must be <= 32
+ * @param n Number of fields
+ * @return false if data does not fit into the output buffer
+ */
+EXTERN_C bool bw_write_fields (bitwriter_t *bw, const uint32_t *vals,
+                               const uint8_t *widths, unsigned n);
+
+/**
+ * Write whole bytes to the byte substream. In forward format
+ * the current byte is padded with zero bits first.
+ *
+ * @param bw Bitstream writer
+ * @param src Pointer to data to write into the bitstream
+ * @param size Data size
+ * @return false if data does not fit into the output buffer
+ */
+EXTERN_C bool bw_write_bytes (bitwriter_t *bw, const void *src, unsigned size);
+
+/**
+ * Finish writing, padding the last byte of bits with zeros.
+ * The gap between the byte and bit substreams is removed, as with
+ * bs_write_finish(). In forward format the rest of data is passed
+ * to output callback, if any.
+ *
+ * @param bw Bitstream writer
+ * @return Total size of bitstream data, 0 on error
+ */
+EXTERN_C unsigned bw_finish (bitwriter_t *bw);
+
 #endif // _BITSTREAM_H
@@ -131,6 +131,15 @@ EXTERN_C void CLIKE_P (memclr) (void *dest, unsigned len);
  */
 EXTERN_C void *CLIKE_P (memcpy) (void *dest, const void *src, size_t len);
 
+/**
+ * Optimized traditional memmove().
+ * Unlike memcpy(), source and destination areas may overlap.
+ * @arg dest The destination pointer
+ * @arg src Source pointer
+ * @arg len Number of bytes to copy
+ */
+EXTERN_C void *CLIKE_P (memmove) (void *dest, const void *src, size_t len);
+
 /**
  * Optimized traditional memcmp().
  * Compare two memory areas.
@@ -20,8 +20,94 @@
  *      will give you pretty fast decompression speeds.
  */
 
+/**
+ * The size of match finder working memory used by ulz_compress().
+ * This memory is allocated on stack, so it is kept small on microcontrollers.
+ * More memory gives faster compression and, usually, slightly better ratio.
+ * You may override this value from the compiler command line.
+ */
+#ifndef ULZ_WORKMEM_SIZE
+#  if defined ARCH_ARM
+#    define ULZ_WORKMEM_SIZE    1024
+#  else
+#    define ULZ_WORKMEM_SIZE    (256 * 1024)
+#  endif
+#endif
+
+/**
+ * Compression levels. Higher levels give better compression at the cost
+ * of compression speed; decompression is not affected at all.
+ */
+/// Take the best reference at every position (fastest)
+#define ULZ_LEVEL_GREEDY        0
+/// Defer a reference if a better one starts at next position
+#define ULZ_LEVEL_LAZY          1
+/// Find the cheapest encoding in bits; needs at least 96 KiB of working
+/// memory, with less memory it falls back to ULZ_LEVEL_LAZY
+#define ULZ_LEVEL_OPTIMAL       2
+
+/**
+ * Compression level may be OR'ed with this flag to produce the repeat
+ * offset variant of uLZ format, where references may reuse one of two
+ * last offsets with a short code. This is good for structured binary data
+ * like arrays of records, but such blocks must be decompressed with
+ * ulz_decompress_rep(). Blocks get a 6-byte variant header which makes
+ * other decoders fail on them. In-place images, dictionary compression
+ * and streams don't support this variant and ignore the flag.
+ */
+#define ULZ_FLAG_REPOFS         0x100
+
+/**
+ * Compression level may be OR'ed with this flag to produce the literal
+ * Huffman variant of uLZ format, where literal bytes are coded with
+ * a Huffman code built for every block. This is good for text and logs,
+ * where literals take most of compressed data. Compression takes twice
+ * as long and 2 KiB more stack; such blocks must be decompressed with
+ * ulz_decompress_huff(), which needs about 1.1 KiB of stack for its code
+ * tables (1.3 KiB on x86_64). Blocks get the variant header, same as with
+ * ULZ_FLAG_REPOFS. The flag overrides ULZ_FLAG_REPOFS; in-place images
+ * and dictionary compression ignore it.
+ */
+#define ULZ_FLAG_HUFF           0x200
+
+/**
+ * Compression level may be OR'ed with this flag to produce the large
+ * window variant of uLZ format, where references may reach up to
+ * ULZ_LARGE_OFS_MAX bytes back with a compact offset code. This is meant
+ * for packing big archives on the host, where repeats may be megabytes
+ * apart; with this flag the match finder also keeps a long range hash
+ * table, so give it a few megabytes of working memory. Such blocks must
+ * be decompressed with ulz_decompress_large() and get the variant header,
+ * same as with ULZ_FLAG_REPOFS. The flag overrides ULZ_FLAG_REPOFS and
+ * combines with ULZ_FLAG_HUFF; in-place images and dictionary compression
+ * ignore it.
+ */
+#define ULZ_FLAG_LARGE          0x400
+
+/**
+ * Streaming compressor level may be OR'ed with this flag to mark the frame
+ * as holding data passed through the Thumb branch filter. The compressor
+ * doesn't filter data by itself: put an ulz_thumb_t in front of
+ * ulz_cstream_feed(); ulz_dstream converts data back on such frames.
+ * Block compression functions don't accept this flag.
+ */
+#define ULZ_FLAG_THUMB          0x800
+
+/// The farthest reference in the large window variant of uLZ format
+#define ULZ_LARGE_OFS_MAX       (1U << 24)
+
+/**
+ * Compressed block size in the worst case. Data that doesn't compress
+ * is stored as a single literal: size header (up to 5 bytes), literal
+ * length (up to 19 bits plus 32-bit escape) and the data itself.
+ * Blocks in format variants also have a 6-byte variant header.
+ * Compression never fails with output buffer at least this large.
+ */
+#define ULZ_COMPRESS_BOUND(n)   ((n) + 18)
+
 /**
  * Compress a block of data.
+ * This uses ULZ_WORKMEM_SIZE bytes of stack for match finder.
  *
  * @param idata A pointer to input data
  * @param isize The size of input data.
@@ -29,10 +115,94 @@
  * @param osize A pointer to a variable that gets the size of output
  *      (compressed) data. On entry it contains the allocated size
  *      of the output buffer.
- * @return true if compressed data does not fit into output buffer.
+ * @param level Compression level, one of ULZ_LEVEL_XXX
+ * @return false if compressed data does not fit into output buffer,
+ *      never happens if it's at least ULZ_COMPRESS_BOUND (isize) bytes.
  */
 EXTERN_C bool ulz_compress (const void *idata, unsigned isize,
-                          void *odata, unsigned *osize);
+                          void *odata, unsigned *osize, unsigned level);
+
+/**
+ * Compress a block of data using caller-provided working memory.
+ * Use this if you want to set match finder memory at run time, e.g.
+ * a few hundreds bytes on a microcontroller and megabytes on a PC.
+ * The stream format doesn't depend on working memory size.
+ *
+ * @param idata A pointer to input data
+ * @param isize The size of input data.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @param workmem A pointer to working memory, 32-bit aligned
+ * @param workmem_size Working memory size, at least 16 bytes
+ * @param level Compression level, one of ULZ_LEVEL_XXX
+ * @return false if compressed data does not fit into output buffer,
+ *      never happens if it's at least ULZ_COMPRESS_BOUND (isize) bytes.
+ */
+EXTERN_C bool ulz_compress_wm (const void *idata, unsigned isize,
+                               void *odata, unsigned *osize,
+                               void *workmem, unsigned workmem_size,
+                               unsigned level);
+
+/**
+ * Compress a block of data into an in-place image, which can be
+ * decompressed by ulz_decompress_inplace() within a single buffer
+ * only slightly larger than uncompressed data. Besides compressed data
+ * the image keeps the required buffer size.
+ *
+ * @param idata A pointer to input data
+ * @param isize The size of input data.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @param workmem A pointer to working memory, 32-bit aligned
+ * @param workmem_size Working memory size, at least 16 bytes
+ * @param level Compression level, one of ULZ_LEVEL_XXX
+ * @return false if compressed data does not fit into output buffer,
+ *      never happens if it's at least ULZ_COMPRESS_BOUND (isize) + 5 bytes.
+ */
+EXTERN_C bool ulz_compress_inplace (const void *idata, unsigned isize,
+                                    void *odata, unsigned *osize,
+                                    void *workmem, unsigned workmem_size,
+                                    unsigned level);
+
+/**
+ * References can't reach farther back than this, so only this many
+ * last bytes of a preset dictionary are used.
+ */
+#define ULZ_DICT_MAX            65536
+
+/**
+ * Compress a block of data using a preset dictionary. References may point
+ * into dictionary as if it immediately preceeded the data, so small
+ * messages similar to the dictionary compress much better. Exactly same
+ * dictionary must be passed to ulz_decompress_dict().
+ *
+ * The dictionary and data are copied to the start of working memory,
+ * the rest is used by the match finder.
+ *
+ * @param dict A pointer to dictionary
+ * @param dict_size Dictionary size
+ * @param idata A pointer to input data
+ * @param isize The size of input data.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @param workmem A pointer to working memory, 32-bit aligned
+ * @param workmem_size Working memory size, at least dictionary plus
+ *      data size plus 16 bytes
+ * @param level Compression level, one of ULZ_LEVEL_XXX
+ * @return false if compressed data does not fit into output buffer,
+ *      or working memory is too small.
+ */
+EXTERN_C bool ulz_compress_dict (const void *dict, unsigned dict_size,
+                                 const void *idata, unsigned isize,
+                                 void *odata, unsigned *osize,
+                                 void *workmem, unsigned workmem_size,
+                                 unsigned level);
 
 /**
  * Get uncompressed size of a compressed block.
@@ -41,6 +211,7 @@ EXTERN_C bool ulz_compress (const void *idata, unsigned isize,
  * @param idata A pointer to compressed block.
  * @param isize The size of compressed block in bytes.
  * @return The size of the uncompressed data or 0 if data seems damaged.
+ *      Blocks in format variants report an impossibly large size.
  */
 EXTERN_C unsigned ulz_decompress_size (const void *idata, unsigned isize);
 
@@ -58,4 +229,515 @@ EXTERN_C unsigned ulz_decompress_size (const void *idata, unsigned isize);
 EXTERN_C bool ulz_decompress (const void *idata, unsigned isize,
                             void *odata, unsigned *osize);
 
+/**
+ * Uncompress a block of data compressed with a preset dictionary.
+ * The dictionary is copied to the start of output buffer for references
+ * to work, so output buffer must have room for both dictionary and data.
+ * Decompressed data is then moved to the start of output buffer.
+ *
+ * @param dict A pointer to dictionary, same as passed to ulz_compress_dict()
+ * @param dict_size Dictionary size
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (uncompressed) data. On entry it contains the allocated size
+ *      of the output buffer, which must be at least as much as
+ *      uncompressed data size plus MIN (dict_size, ULZ_DICT_MAX).
+ * @return false if data is damaged or does not fit into output buffer.
+ */
+EXTERN_C bool ulz_decompress_dict (const void *dict, unsigned dict_size,
+                                   const void *idata, unsigned isize,
+                                   void *odata, unsigned *osize);
+
+/**
+ * Get the size of buffer needed to decompress an in-place image.
+ *
+ * @param idata A pointer to in-place image.
+ * @param isize The size of in-place image in bytes.
+ * @return Required buffer size or 0 if data seems damaged.
+ */
+EXTERN_C unsigned ulz_inplace_size (const void *idata, unsigned isize);
+
+/**
+ * Decompress an in-place image placed at the very end of a buffer
+ * into the start of same buffer. The buffer must be at least
+ * ulz_inplace_size() bytes, otherwise decompression would overwrite
+ * compressed data before reading it.
+ *
+ * @param buff A pointer to buffer
+ * @param buff_size Buffer size
+ * @param isize The size of in-place image in bytes, at the end of buffer
+ * @param osize A pointer to a variable that gets the size of
+ *      uncompressed data, at the start of buffer
+ * @return false if data is damaged or buffer is too small
+ */
+EXTERN_C bool ulz_decompress_inplace (void *buff, unsigned buff_size,
+                                      unsigned isize, unsigned *osize);
+
+/**
+ * Same as ulz_decompress(), but optimized for speed rather than size.
+ * Decodes references by words and reads the bit substream through
+ * a 32-bit reservoir. Use this if decompression speed matters more than
+ * a few hundreds bytes of code; output is exactly the same.
+ *
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @return false if data is damaged or does not fit into output buffer.
+ */
+EXTERN_C bool ulz_decompress_fast (const void *idata, unsigned isize,
+                                   void *odata, unsigned *osize);
+
+/**
+ * Uncompress a block of data in the repeat offset variant of uLZ format,
+ * produced by compression with ULZ_FLAG_REPOFS. Uses same optimizations
+ * as ulz_decompress_fast(). Blocks in other formats are rejected.
+ *
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @return false if data is damaged or does not fit into output buffer.
+ */
+EXTERN_C bool ulz_decompress_rep (const void *idata, unsigned isize,
+                                  void *odata, unsigned *osize);
+
+/**
+ * Uncompress a block of data in the literal Huffman variant of uLZ
+ * format, produced by compression with ULZ_FLAG_HUFF. Blocks in other
+ * formats are rejected.
+ *
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @return false if data is damaged or does not fit into output buffer.
+ */
+EXTERN_C bool ulz_decompress_huff (const void *idata, unsigned isize,
+                                   void *odata, unsigned *osize);
+
+/**
+ * Uncompress a block of data in the large window variant of uLZ format,
+ * produced by compression with ULZ_FLAG_LARGE. Blocks in other formats,
+ * including the large window one with different @a huff, are rejected.
+ *
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @param huff true if the block was compressed with ULZ_FLAG_HUFF too
+ * @return false if data is damaged or does not fit into output buffer.
+ */
+EXTERN_C bool ulz_decompress_large (const void *idata, unsigned isize,
+                                    void *odata, unsigned *osize, bool huff);
+
+// -------------------------------------------------------------------------- //
+
+/**
+ * Streaming compression produces an uLZ frame: a sequence of uLZ blocks
+ * each encoding at most (1 << blk_log) bytes of data. Blocks may reference
+ * up to (1 << win_log) bytes of preceeding data, so the compressor keeps
+ * only a bounded window of input in memory.
+ */
+
+/// Maximal window size, log2
+#define ULZ_FRAME_WIN_LOG_MAX   16
+/// Maximal window size, log2, in the large window variant of uLZ format
+#define ULZ_FRAME_WIN_LOG_LARGE_MAX 24
+/// Minimal block size, log2
+#define ULZ_FRAME_BLK_LOG_MIN   6
+/// Maximal block size, log2
+#define ULZ_FRAME_BLK_LOG_MAX   24
+
+/**
+ * A callback used by streaming functions to output data.
+ *
+ * @param ctx User-defined context
+ * @param data A pointer to output data
+ * @param size Data size
+ * @return false to abort processing
+ */
+typedef bool (*ulz_write_t) (void *ctx, const void *data, unsigned size);
+
+/// The least match finder memory ulz_cstream_init() accepts, bytes
+#define ULZ_CSTREAM_WORKMEM_MIN 1024
+/**
+ * Every block is compressed with the match finder rebuilt over the whole
+ * history window, so the cost per byte grows with the window to block
+ * size ratio. The window may be at most (1 << ULZ_CSTREAM_WIN_BLK_LOG)
+ * blocks large, which makes compression up to about 4 times slower than
+ * with the window same size as block.
+ */
+#define ULZ_CSTREAM_WIN_BLK_LOG 4
+
+/**
+ * Compute how much memory ulz_cstream_init() needs for given
+ * window and block size, and match finder memory size
+ * (at least ULZ_CSTREAM_WORKMEM_MIN).
+ */
+#define ULZ_CSTREAM_MEM(win_log, blk_log, workmem_size) \
+    (((win_log) ? (1U << (win_log)) : 0) + (2U << (blk_log)) + (workmem_size))
+
+/**
+ * Streaming compressor state.
+ */
+typedef struct
+{
+    /// Output function
+    ulz_write_t write;
+    /// Output function context
+    void *ctx;
+    /// Match finder working memory
+    void *workmem;
+    /// Match finder working memory size
+    unsigned workmem_size;
+    /// History window followed by current block data
+    uint8_t *buff;
+    /// Compressed block buffer, (1 << blk_log) bytes
+    uint8_t *obuf;
+    /// Window size, bytes
+    unsigned win_size;
+    /// Block size, bytes
+    unsigned blk_size;
+    /// Number of history bytes at the start of buff
+    unsigned hist;
+    /// Number of bytes in buff (history + pending data)
+    unsigned fill;
+    /// Compression level, ULZ_LEVEL_GREEDY after init, may be changed anytime;
+    /// ULZ_FLAG_HUFF, ULZ_FLAG_LARGE and ULZ_FLAG_THUMB may be added only
+    /// before the frame header is output
+    unsigned level;
+    /// Block size, log2
+    uint8_t blk_log;
+    /// Window size, log2
+    uint8_t win_log;
+    /// Frame header has been output
+    bool started;
+    /// Blocks use the literal Huffman variant of uLZ format
+    bool huff;
+    /// Blocks use the large window variant of uLZ format
+    bool large;
+} ulz_cstream_t;
+
+/**
+ * Initialize a streaming compressor. The frame header is output along
+ * with the first block, so compression level and flags may be set
+ * in cs->level after this.
+ *
+ * The memory passed to this function is used for the history window,
+ * block buffers and for match finder; use ULZ_CSTREAM_MEM() to compute
+ * the size. For example, 4 KiB window and 1 KiB blocks with 1 KiB
+ * of match finder memory will need 7 KiB.
+ *
+ * @param cs Compressor state
+ * @param win_log Window size, log2; 0 means every block is self-contained.
+ *      Windows above ULZ_FRAME_WIN_LOG_MAX, up to ULZ_FRAME_WIN_LOG_LARGE_MAX,
+ *      imply ULZ_FLAG_LARGE. At most blk_log + ULZ_CSTREAM_WIN_BLK_LOG.
+ * @param blk_log Block size, log2
+ * @param mem A pointer to working memory, 32-bit aligned
+ * @param mem_size Working memory size
+ * @param write The output function
+ * @param ctx Output function context
+ * @return false if parameters are wrong or there's less than
+ *      ULZ_CSTREAM_WORKMEM_MIN bytes of memory left for match finder
+ */
+EXTERN_C bool ulz_cstream_init (ulz_cstream_t *cs, unsigned win_log, unsigned blk_log,
+                                void *mem, unsigned mem_size,
+                                ulz_write_t write, void *ctx);
+
+/**
+ * Feed a chunk of data to the streaming compressor.
+ * Every time a whole block accumulates, it is compressed and passed
+ * to the output function.
+ *
+ * @param cs Compressor state
+ * @param data A pointer to data
+ * @param size Data size
+ * @return false if output function fails
+ */
+EXTERN_C bool ulz_cstream_feed (ulz_cstream_t *cs, const void *data, unsigned size);
+
+/**
+ * Compress and output all pending data as a (possibly short) block.
+ * This does not reset the window, so compression may continue after this.
+ *
+ * @param cs Compressor state
+ * @return false if output function fails
+ */
+EXTERN_C bool ulz_cstream_flush (ulz_cstream_t *cs);
+
+/**
+ * Flush pending data and terminate the frame.
+ * The compressor state must not be used after this, except for
+ * re-initialization with ulz_cstream_init().
+ *
+ * @param cs Compressor state
+ * @return false if output function fails
+ */
+EXTERN_C bool ulz_cstream_finish (ulz_cstream_t *cs);
+
+// -------------------------------------------------------------------------- //
+
+/**
+ * Thumb-2 BL and B.W instructions keep the branch target as an offset
+ * from the instruction itself, so calls to the same function look
+ * different everywhere in the code. Converting these offsets to absolute
+ * addresses before compression gives LZ much more matches on firmware
+ * images; decompressed data is converted back.
+ *
+ * Data is scanned by halfwords from the start, the conversion is fully
+ * reversible whatever the data is, including data not being code at all.
+ * A 4-byte instruction can't be converted until all of it is available,
+ * so the function returns how many bytes have been processed: at most
+ * 3 bytes at the end are left as is. When data goes in chunks, pass these
+ * bytes again at the start of next chunk with pos advanced by the number
+ * of processed bytes; at the end of data they are left unconverted.
+ *
+ * @param data A pointer to data, converted in place
+ * @param size Data size
+ * @param pos Position of data in the whole stream (or its load address),
+ *      must be even and same for conversion and back conversion
+ * @param encode true to convert relative offsets to absolute addresses,
+ *      false for back conversion
+ * @return Number of bytes processed
+ */
+EXTERN_C unsigned ulz_thumb_filter (void *data, unsigned size, uint32_t pos, bool encode);
+
+/// The size of ulz_thumb_t buffer
+#define ULZ_THUMB_BUF_SIZE      64
+
+/**
+ * Streaming Thumb branch filter state. It gets data chunks of any size
+ * and passes converted data to the output function, so it may be put
+ * in front of ulz_cstream_feed() or after a streaming decompressor.
+ */
+typedef struct
+{
+    /// Output function
+    ulz_write_t write;
+    /// Output function context
+    void *ctx;
+    /// Stream position of buf [0]
+    uint32_t pos;
+    /// Number of bytes in buf
+    unsigned fill;
+    /// Conversion direction
+    bool encode;
+    /// Data waiting for conversion
+    uint8_t buf [ULZ_THUMB_BUF_SIZE];
+} ulz_thumb_t;
+
+/**
+ * Initialize a streaming Thumb branch filter.
+ *
+ * @param tf Filter state
+ * @param encode Conversion direction, see ulz_thumb_filter()
+ * @param write The output function, receives converted data
+ * @param ctx Output function context
+ */
+EXTERN_C void ulz_thumb_init (ulz_thumb_t *tf, bool encode,
+                              ulz_write_t write, void *ctx);
+
+/**
+ * Feed a chunk of data to the streaming filter.
+ * This has same prototype as ulz_write_t, with ulz_thumb_t as context.
+ *
+ * @param ctx Filter state
+ * @param data A pointer to data
+ * @param size Data size
+ * @return false if output function fails
+ */
+EXTERN_C bool ulz_thumb_write (void *ctx, const void *data, unsigned size);
+
+/**
+ * Output the last few bytes left unconverted at the end of data.
+ *
+ * @param tf Filter state
+ * @return false if output function fails
+ */
+EXTERN_C bool ulz_thumb_finish (ulz_thumb_t *tf);
+
+// -------------------------------------------------------------------------- //
+
+/**
+ * Compute how much memory ulz_dstream_init() needs to decode a frame
+ * with given window and block size.
+ */
+#define ULZ_DSTREAM_MEM(win_log, blk_log) \
+    (((win_log) ? (1U << (win_log)) : 0) + (2U << (blk_log)))
+
+/// Streaming decompressor is waiting for frame header
+#define ULZ_DS_HEADER           0
+/// Streaming decompressor is waiting for block header
+#define ULZ_DS_BLKHDR           1
+/// Streaming decompressor is collecting block data
+#define ULZ_DS_BLOCK            2
+/// Frame has been successfully decoded
+#define ULZ_DS_DONE             3
+/// Broken data, not enough memory or output function failed
+#define ULZ_DS_ERROR            4
+
+/**
+ * Streaming (push-mode) decompressor state.
+ */
+typedef struct
+{
+    /// Output function
+    ulz_write_t write;
+    /// Output function context
+    void *ctx;
+    /// Working memory
+    uint8_t *mem;
+    /// Working memory size
+    unsigned mem_size;
+    /// Compressed block buffer
+    uint8_t *ibuf;
+    /// Window size, bytes
+    unsigned win_size;
+    /// Block size, bytes
+    unsigned blk_size;
+    /// Number of history bytes at the start of mem
+    unsigned hist;
+    /// Current block (or header) size
+    unsigned need;
+    /// Number of bytes of current block (or header) collected so far
+    unsigned have;
+    /// Bit shift for the next uleb128 chip of block header
+    uint8_t shift;
+    /// True if current block is stored uncompressed
+    bool stored;
+    /// True if frame data goes through Thumb branch filter
+    bool thumb;
+    /// True if blocks use the literal Huffman variant of uLZ format
+    bool huff;
+    /// True if blocks use the large window variant of uLZ format
+    bool large;
+    /// Decoder state, one of ULZ_DS_XXX
+    uint8_t state;
+    /// Thumb branch filter, used if frame header asks for it
+    ulz_thumb_t tf;
+} ulz_dstream_t;
+
+/**
+ * Initialize a streaming decompressor.
+ *
+ * Frame parameters are not known until frame header is received, so if
+ * the memory is not enough (see ULZ_DSTREAM_MEM()), ulz_dstream_feed()
+ * will fail as soon as frame header is received. This is how frames
+ * with a window too large for a microcontroller are rejected.
+ *
+ * @param ds Decompressor state
+ * @param mem A pointer to working memory
+ * @param mem_size Working memory size
+ * @param write The output function, receives decompressed data
+ * @param ctx Output function context
+ */
+EXTERN_C void ulz_dstream_init (ulz_dstream_t *ds, void *mem, unsigned mem_size,
+                                ulz_write_t write, void *ctx);
+
+/**
+ * Feed a chunk of compressed frame to the streaming decompressor.
+ * Data may be split at any point, down to one byte at a time.
+ * Decompressed data is passed to the output function block by block,
+ * as soon as every block is received. If frame data has been passed
+ * through Thumb branch filter, it is converted back on the way.
+ *
+ * @param ds Decompressor state
+ * @param data A pointer to compressed data
+ * @param size Compressed data size
+ * @return false on error (ds->state is set to ULZ_DS_ERROR)
+ */
+EXTERN_C bool ulz_dstream_feed (ulz_dstream_t *ds, const void *data, unsigned size);
+
+/**
+ * Check if the whole frame has been decoded.
+ *
+ * @param ds Decompressor state
+ * @return true if frame terminator has been received
+ */
+INLINE_ALWAYS bool ulz_dstream_done (ulz_dstream_t *ds)
+{ return ds->state == ULZ_DS_DONE; }
+
+// -------------------------------------------------------------------------- //
+
+/**
+ * An indexed container keeps data in separately compressed blocks along
+ * with a block index, so that any piece of data can be decoded without
+ * decoding everything before it. Containers are created by the ulz tool
+ * (see the -i option).
+ */
+
+/// No block is decoded in scratch buffer
+#define ULZ_IX_NONE             0xFFFFFFFFU
+
+/**
+ * Indexed container reader state.
+ */
+typedef struct
+{
+    /// Block end offsets
+    const uint8_t *ofs;
+    /// Block checksums
+    const uint8_t *crc;
+    /// Block data
+    const uint8_t *data;
+    /// Block data size
+    unsigned data_size;
+    /// Uncompressed data size
+    unsigned size;
+    /// Number of blocks
+    unsigned count;
+    /// Block size, log2
+    unsigned blk_log;
+    /// Blocks use repeat offset variant of uLZ format
+    bool repofs;
+    /// Blocks use literal Huffman variant of uLZ format
+    bool huff;
+    /// Scratch buffer for one decoded block
+    uint8_t *scratch;
+    /// The block in scratch buffer, or ULZ_IX_NONE
+    unsigned cached;
+} ulz_ix_t;
+
+/**
+ * Prepare to read from an indexed container.
+ *
+ * Blocks which are accessed partially are decoded into the scratch
+ * buffer, which must be at least as large as container block size.
+ * The last decoded block is kept there, so reading small consecutive
+ * pieces of data doesn't decode same block again and again.
+ *
+ * @param ix Reader state
+ * @param data A pointer to container, 32-bit aligned
+ * @param size Container size
+ * @param scratch A pointer to scratch buffer, 16-bit aligned
+ * @param scratch_size Scratch buffer size
+ * @return false if container is damaged or scratch buffer is too small
+ */
+EXTERN_C bool ulz_ix_init (ulz_ix_t *ix, const void *data, unsigned size,
+                           void *scratch, unsigned scratch_size);
+
+/**
+ * Read a piece of data from an indexed container.
+ * Only the blocks covering the requested range are decoded,
+ * and every decoded block is verified against its checksum.
+ *
+ * @param ix Reader state
+ * @param offset Offset of data to read
+ * @param dst Output buffer
+ * @param len Number of bytes to read
+ * @return false if range is out of data, or container is damaged
+ */
+EXTERN_C bool ulz_read_at (ulz_ix_t *ix, unsigned offset, void *dst, unsigned len);
+
 #endif // _ULZ_H
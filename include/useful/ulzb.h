@@ -0,0 +1,98 @@
+/*
+    uLZB compression library
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#ifndef _ULZB_H
+#define _ULZB_H
+
+#include "ulz.h"
+
+/**
+ * @file ulzb.h
+ *      uLZB is a byte-aligned variant of uLZ, similar to LZ4. Lengths are
+ *      packed into nibbles of a token byte and offsets take two bytes,
+ *      so decoder needs only byte loads and word copies. It compresses
+ *      a few percent worse than uLZ, but decompresses several times faster
+ *      on cores without barrel shifter, like Cortex-M0.
+ *
+ *      The API is same as for uLZ, working memory size and compression
+ *      levels are also the same, except that ULZ_LEVEL_OPTIMAL works
+ *      like ULZ_LEVEL_LAZY.
+ */
+
+/**
+ * Compressed block size in the worst case, when data is stored
+ * as a single literal. Compression never fails with output buffer
+ * at least this large.
+ */
+#define ULZB_COMPRESS_BOUND(n)  ((n) + (n) / 255 + 7)
+
+/**
+ * Compress a block of data.
+ * This uses ULZ_WORKMEM_SIZE bytes of stack for match finder.
+ *
+ * @param idata A pointer to input data
+ * @param isize The size of input data.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @param level Compression level, one of ULZ_LEVEL_XXX
+ * @return false if compressed data does not fit into output buffer,
+ *      never happens if it's at least ULZB_COMPRESS_BOUND (isize) bytes.
+ */
+EXTERN_C bool ulzb_compress (const void *idata, unsigned isize,
+                             void *odata, unsigned *osize, unsigned level);
+
+/**
+ * Compress a block of data using caller-provided working memory.
+ *
+ * @param idata A pointer to input data
+ * @param isize The size of input data.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (compressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @param workmem A pointer to working memory, 32-bit aligned
+ * @param workmem_size Working memory size, at least 16 bytes
+ * @param level Compression level, one of ULZ_LEVEL_XXX
+ * @return false if compressed data does not fit into output buffer,
+ *      never happens if it's at least ULZB_COMPRESS_BOUND (isize) bytes.
+ */
+EXTERN_C bool ulzb_compress_wm (const void *idata, unsigned isize,
+                                void *odata, unsigned *osize,
+                                void *workmem, unsigned workmem_size,
+                                unsigned level);
+
+/**
+ * Get uncompressed size of a compressed block.
+ * uLZB blocks start with same header as uLZ ones.
+ *
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @return The size of the uncompressed data or 0 if data seems damaged.
+ */
+INLINE_ALWAYS unsigned ulzb_decompress_size (const void *idata, unsigned isize)
+{
+    return ulz_decompress_size (idata, isize);
+}
+
+/**
+ * Uncompress a compressed block of data.
+ *
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @param odata A pointer to output buffer (uninitialized)
+ * @param osize A pointer to a variable that gets the size of output
+ *      (uncompressed) data. On entry it contains the allocated size
+ *      of the output buffer.
+ * @return false if data is damaged or does not fit into output buffer.
+ */
+EXTERN_C bool ulzb_decompress (const void *idata, unsigned isize,
+                               void *odata, unsigned *osize);
+
+#endif // _ULZB_H
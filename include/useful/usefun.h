@@ -49,6 +49,11 @@ EXTERN_C void xs_seed (xs_rng_t xsr, uint32_t seed);
  */
 EXTERN_C uint32_t xs_rand (xs_rng_t xsr);
 
+/// Max size of a 32-bit number in LEB128 format
+#define LEB128_MAX_32           5
+/// Max size of a 64-bit number in LEB128 format
+#define LEB128_MAX_64           10
+
 /**
  * Decode a number in the unsigned LEB128 format
  * @arg data A pointer to encoded data. On return this pointer
@@ -65,6 +70,111 @@ EXTERN_C uint32_t uleb128 (const uint8_t **data);
  */
 EXTERN_C int32_t sleb128 (const uint8_t **data);
 
+/**
+ * Decode a 64-bit number in the unsigned LEB128 format
+ * @arg data A pointer to encoded data. On return this pointer
+ *      is updated to point past the encoded data.
+ * @return The decoded number
+ */
+EXTERN_C uint64_t uleb128_64 (const uint8_t **data);
+
+/**
+ * Decode a 64-bit number in the signed LEB128 format
+ * @arg data A pointer to encoded data. On return this pointer
+ *      is updated to point past the encoded data.
+ * @return The decoded number
+ */
+EXTERN_C int64_t sleb128_64 (const uint8_t **data);
+
+/**
+ * Decode a number in the unsigned LEB128 format, never reading
+ * at or past @a end.
+ * @arg data A pointer to encoded data. On success this pointer
+ *      is updated to point past the encoded data.
+ * @arg end End of encoded data
+ * @arg value Receives the decoded number
+ * @return false if data ends before the number does, or if the number
+ *      takes more than LEB128_MAX_32 bytes or does not fit into 32 bits
+ */
+EXTERN_C bool uleb128_n (const uint8_t **data, const uint8_t *end, uint32_t *value);
+
+/**
+ * Decode a number in the signed LEB128 format, never reading
+ * at or past @a end.
+ * @arg data A pointer to encoded data. On success this pointer
+ *      is updated to point past the encoded data.
+ * @arg end End of encoded data
+ * @arg value Receives the decoded number
+ * @return false if data ends before the number does, or if the number
+ *      takes more than LEB128_MAX_32 bytes or does not fit into 32 bits
+ */
+EXTERN_C bool sleb128_n (const uint8_t **data, const uint8_t *end, int32_t *value);
+
+/**
+ * Same as uleb128_n(), but for 64-bit numbers up to LEB128_MAX_64 bytes long.
+ */
+EXTERN_C bool uleb128_64_n (const uint8_t **data, const uint8_t *end, uint64_t *value);
+
+/**
+ * Same as sleb128_n(), but for 64-bit numbers up to LEB128_MAX_64 bytes long.
+ */
+EXTERN_C bool sleb128_64_n (const uint8_t **data, const uint8_t *end, int64_t *value);
+
+/**
+ * Decode a sequence of numbers in the unsigned LEB128 format.
+ * This is much faster than decoding them one by one: value ends are
+ * looked for a machine word at a time (or more, where CPU allows).
+ * @arg data A pointer to encoded data. On return this pointer
+ *      is updated to point past the last decoded number.
+ * @arg end End of encoded data
+ * @arg values Receives the decoded numbers
+ * @arg count Number of values to decode
+ * @return Number of values decoded; less than @a count if data ends,
+ *      or a malformed number is met (see uleb128_n())
+ */
+EXTERN_C unsigned uleb128_array (const uint8_t **data, const uint8_t *end,
+                                 uint32_t *values, unsigned count);
+
+/**
+ * Encode a number in the unsigned LEB128 format
+ * @arg data Output buffer, at least LEB128_MAX_32 bytes or uleb128_len()
+ * @arg value The number to encode
+ * @return A pointer past the encoded data
+ */
+EXTERN_C uint8_t *put_uleb128 (uint8_t *data, uint32_t value);
+
+/**
+ * Encode a number in the signed LEB128 format
+ * @arg data Output buffer, at least LEB128_MAX_32 bytes
+ * @arg value The number to encode
+ * @return A pointer past the encoded data
+ */
+EXTERN_C uint8_t *put_sleb128 (uint8_t *data, int32_t value);
+
+/**
+ * Encode a 64-bit number in the unsigned LEB128 format
+ * @arg data Output buffer, at least LEB128_MAX_64 bytes
+ * @arg value The number to encode
+ * @return A pointer past the encoded data
+ */
+EXTERN_C uint8_t *put_uleb128_64 (uint8_t *data, uint64_t value);
+
+/**
+ * Encode a 64-bit number in the signed LEB128 format
+ * @arg data Output buffer, at least LEB128_MAX_64 bytes
+ * @arg value The number to encode
+ * @return A pointer past the encoded data
+ */
+EXTERN_C uint8_t *put_sleb128_64 (uint8_t *data, int64_t value);
+
+/**
+ * Return the size of a number in the unsigned LEB128 format
+ * @arg value The number
+ * @return Encoded number size in bytes
+ */
+INLINE_ALWAYS unsigned uleb128_len (uint32_t value)
+{ unsigned len = 1; while (value >>= 7) len++; return len; }
+
 /**
  * Skip an (unused) LEB128 value
  * @arg data A pointer to encoded data
@@ -14,6 +14,9 @@
  * @li Reset_Handler sets stack pointer, copies static data to RAM
  *     and fills uninitialized data with zeros.
  * @li Then it calls SystemInit function.
+ * @li If firmware was built with STM32.DATA.ULZ=1, static data is kept
+ *     in flash compressed, and SystemInit unpacks it to RAM first.
+ *     If the image is damaged, SystemInit stops there for good.
  * @li SystemInit initializes system clock by calling clock_init ().
  * @li SystemInit invokes a special weak function early_init (),
  *     which can be overriden by user, if desired.
@@ -32,6 +35,14 @@
 
 extern void clock_init ();
 
+#ifdef STM32_DATA_ULZ
+#include "useful/ulz.h"
+
+// Defined in linker script
+extern uint8_t __data_start__ [], __data_end__ [];
+extern const uint8_t _sidata_ulz [], _eidata_ulz [];
+#endif
+
 /*
  * User may override this function, if desired.
  *
@@ -44,6 +55,15 @@ void early_init () {}
 // Called from startup code written in assembler
 void SystemInit ()
 {
+#ifdef STM32_DATA_ULZ
+    // Must be done before anything touches static data
+    unsigned size = __data_end__ - __data_start__;
+    if (!ulz_decompress (_sidata_ulz, _eidata_ulz - _sidata_ulz, __data_start__, &size) ||
+        (size != (unsigned)(__data_end__ - __data_start__)))
+        // Damaged firmware image, running it with garbage data is worse
+        for (;;) DEBUG_BREAK;
+#endif
+
     clock_init ();
     early_init ();
 }
@@ -0,0 +1,487 @@
+/*
+    uLZ benchmark and corpus generator shared by tools and tests
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "useful/ulz.h"
+#include "useful/usefun.h"
+#include "ulzbench/ulzbench.h"
+
+/// Corpus piece sizes
+#define BENCH_TEXT_SIZE         (256 * 1024)
+#define BENCH_TABLE_SIZE        (256 * 1024)
+#define BENCH_CODE_SIZE         (256 * 1024)
+#define BENCH_RANDOM_SIZE       (64 * 1024)
+#define BENCH_ZEROS_SIZE        (64 * 1024)
+/// Room for the last word or instruction running past the end
+#define BENCH_SLACK             64
+/// Text line width
+#define BENCH_TEXT_WIDTH        72
+/// Number of distinct functions called from synthetic code
+#define BENCH_FUNCS             512
+/// Guard bytes after decompressor output
+#define BENCH_GUARD             16
+#define BENCH_GUARD_FILL        0xA5
+
+static const char *const bench_words [] =
+{
+    "the", "of", "and", "to", "a", "in", "is", "it", "that", "for",
+    "on", "with", "as", "be", "by", "this", "are", "from", "or", "at",
+    "not", "data", "block", "when", "which", "if", "all", "one", "will",
+    "can", "has", "but", "each", "was", "there", "more", "bytes", "buffer",
+    "device", "value", "register", "clock", "timer", "interrupt", "flash",
+    "memory", "pointer", "size", "length", "offset", "reference", "literal",
+    "compression", "stream", "window", "output", "input", "error", "state",
+    "function", "return", "bit", "word", "table", "entry", "counter", "mode",
+    "before", "after", "while", "until", "first", "last", "next", "previous",
+    "should", "must", "never", "always", "only", "also", "then", "than",
+    "enabled", "disabled", "configured", "reset", "started", "stopped",
+    "peripheral", "channel", "transfer", "receive", "transmit", "sample",
+    "voltage", "current", "temperature", "sensor", "calibration", "firmware",
+    "bootloader", "application", "section", "address", "alignment", "cache",
+    "instruction", "pipeline", "latency", "throughput", "microcontroller",
+};
+
+/// Store a little-endian 16-bit value
+static void bench_put16 (uint8_t *data, unsigned ofs, unsigned value)
+{
+    data [ofs] = value;
+    data [ofs + 1] = value >> 8;
+}
+
+/// Pick a number in range 0..n-1, small numbers being much more likely
+static unsigned bench_skewed (xs_rng_t rng, unsigned n)
+{
+    return ((xs_rand (rng) % n) * (xs_rand (rng) % n)) / n;
+}
+
+/// Pseudo-English text with a skewed word distribution, wrapped lines and paragraphs
+static void bench_text (uint8_t *data, unsigned size, xs_rng_t rng)
+{
+    char *out = (char *)data;
+    unsigned pos = 0, col = 0, words = 0;
+    unsigned sentence = 8;
+    bool cap = true;
+
+    while (pos < size)
+    {
+        char number [12];
+        const char *word = number;
+        if (xs_rand (rng) % 32 == 0)
+            snprintf (number, sizeof (number), "%u", (unsigned)(xs_rand (rng) % 10000));
+        else
+            word = bench_words [bench_skewed (rng, ARRAY_LEN (bench_words))];
+        unsigned len = strlen (word);
+
+        if (col + len + 2 > BENCH_TEXT_WIDTH)
+        {
+            out [pos++] = '\n';
+            col = 0;
+        }
+        else if (col)
+        {
+            out [pos++] = ' ';
+            col++;
+        }
+
+        memcpy (out + pos, word, len);
+        if (cap && (word [0] >= 'a'))
+            out [pos] += 'A' - 'a';
+        pos += len;
+        col += len;
+        cap = false;
+
+        if (++words >= sentence)
+        {
+            out [pos++] = '.';
+            col++;
+            cap = true;
+            words = 0;
+            sentence = 4 + xs_rand (rng) % 14;
+            if (xs_rand (rng) % 6 == 0)
+            {
+                out [pos++] = '\n';
+                out [pos++] = '\n';
+                col = 0;
+            }
+        }
+        else if (xs_rand (rng) % 12 == 0)
+        {
+            out [pos++] = ',';
+            col++;
+        }
+    }
+}
+
+/// Log records as stored by a data logger: timestamp, temperature, three voltages, flags
+static void bench_table (uint8_t *data, unsigned size, xs_rng_t rng)
+{
+    uint32_t time = 1600000000;
+    int temp = 2250;
+    int volt [3] = { 3300, 5000, 12000 };
+    unsigned flags = 0x0011;
+    unsigned seq = 0;
+
+    for (unsigned pos = 0; pos + 16 <= size; pos += 16)
+    {
+        time += 1000 + xs_rand (rng) % 8;
+        temp += (int)(xs_rand (rng) % 5) - 2;
+        for (unsigned i = 0; i < 3; i++)
+            volt [i] += (int)(xs_rand (rng) % 7) - 3;
+        if (xs_rand (rng) % 1000 == 0)
+            flags ^= 1 << (xs_rand (rng) % 16);
+
+        PUT_UINT32_LE (data, pos, time);
+        bench_put16 (data, pos + 4, temp);
+        bench_put16 (data, pos + 6, volt [0]);
+        bench_put16 (data, pos + 8, volt [1]);
+        bench_put16 (data, pos + 10, volt [2]);
+        bench_put16 (data, pos + 12, flags);
+        bench_put16 (data, pos + 14, seq++);
+    }
+}
+
+/// Thumb code as compiled for Cortex-M: short functions calling each other, literal pools
+static void bench_code (uint8_t *data, unsigned size, xs_rng_t rng)
+{
+    uint32_t funcs [BENCH_FUNCS];
+    unsigned nfuncs = 0;
+    unsigned pos = 0;
+
+#define EMIT16(x) (bench_put16 (data, pos, (x)), pos += 2)
+#define EMIT32(x) (PUT_UINT32_LE (data, pos, (x)), pos += 4)
+#define REG() bench_skewed (rng, 8)
+
+    while (pos + BENCH_SLACK < size)
+    {
+        funcs [nfuncs++ % BENCH_FUNCS] = pos;
+
+        // push {r4-r7, lr}
+        EMIT16 (0xB5F0);
+        for (unsigned n = 8 + xs_rand (rng) % 40; n && (pos + BENCH_SLACK < size); n--)
+            switch (xs_rand (rng) % 12)
+            {
+                case 0: // movs rd, #imm8
+                    EMIT16 (0x2000 | (REG () << 8) | bench_skewed (rng, 256));
+                    break;
+                case 1:
+                case 2: // ldr rd, [rn, #imm5*4]
+                    EMIT16 (0x6800 | (bench_skewed (rng, 32) << 6) | (REG () << 3) | REG ());
+                    break;
+                case 3: // str rd, [rn, #imm5*4]
+                    EMIT16 (0x6000 | (bench_skewed (rng, 32) << 6) | (REG () << 3) | REG ());
+                    break;
+                case 4: // adds rd, rn, rm
+                    EMIT16 (0x1800 | (REG () << 6) | (REG () << 3) | REG ());
+                    break;
+                case 5: // cmp rn, #imm8
+                    EMIT16 (0x2800 | (REG () << 8) | bench_skewed (rng, 256));
+                    break;
+                case 6: // b<cond> short
+                    EMIT16 (0xD000 | ((xs_rand (rng) % 14) << 8) |
+                            ((xs_rand (rng) % 32 - 16) & 0xFF));
+                    break;
+                case 7:
+                case 8: // bl to one of the previous functions
+                {
+                    if (nfuncs == 0)
+                        break;
+                    unsigned known = MIN (nfuncs, BENCH_FUNCS);
+                    uint32_t target = funcs [(nfuncs - 1 - bench_skewed (rng, known)) % BENCH_FUNCS];
+                    uint32_t ofs = (target - (pos + 4)) >> 1;
+                    unsigned s = (ofs >> 23) & 1;
+                    unsigned j1 = (~((ofs >> 22) ^ s)) & 1;
+                    unsigned j2 = (~((ofs >> 21) ^ s)) & 1;
+                    EMIT16 (0xF000 | (s << 10) | ((ofs >> 11) & 0x3FF));
+                    EMIT16 (0xD000 | (j1 << 13) | (j2 << 11) | (ofs & 0x7FF));
+                    break;
+                }
+                case 9: // ldr rd, [pc, #imm8*4]
+                    EMIT16 (0x4800 | (REG () << 8) | (xs_rand (rng) % 32));
+                    break;
+                default: // a common idiom, repeated from somewhere before
+                {
+                    unsigned len = 4 + 2 * (xs_rand (rng) % 8);
+                    if (pos < 1024)
+                        break;
+                    unsigned from = (pos - 1024 + xs_rand (rng) % (1024 - len)) & ~1;
+                    memmove (data + pos, data + from, len);
+                    pos += len;
+                    break;
+                }
+            }
+        // pop {r4-r7, pc}
+        EMIT16 (0xBDF0);
+
+        // Literal pool: RAM variables and peripheral registers
+        if (pos & 2)
+            EMIT16 (0x46C0);
+        for (unsigned n = xs_rand (rng) % 5; n && (pos + BENCH_SLACK < size); n--)
+            if (xs_rand (rng) & 1)
+                EMIT32 (0x20000000 + bench_skewed (rng, 4096) * 4);
+            else
+                EMIT32 (0x40000000 + (xs_rand (rng) % 16) * 0x400 + (xs_rand (rng) % 16) * 4);
+    }
+
+#undef REG
+#undef EMIT32
+#undef EMIT16
+
+    // Erased flash after the code
+    memset (data + pos, 0xFF, size - pos);
+}
+
+static void bench_random (uint8_t *data, unsigned size, xs_rng_t rng)
+{
+    for (unsigned i = 0; i + 4 <= size; i += 4)
+        PUT_UINT32_LE (data, i, xs_rand (rng));
+}
+
+static void bench_zeros (uint8_t *data, unsigned size, xs_rng_t rng)
+{
+    (void)rng;
+    memset (data, 0, size);
+}
+
+bool bench_corpus (bench_data_t *corpus)
+{
+    static const struct
+    {
+        const char *name;
+        unsigned size;
+        void (*gen) (uint8_t *data, unsigned size, xs_rng_t rng);
+    } pieces [BENCH_CORPUS_SIZE] =
+    {
+        { "text", BENCH_TEXT_SIZE, bench_text },
+        { "tables", BENCH_TABLE_SIZE, bench_table },
+        { "code", BENCH_CODE_SIZE, bench_code },
+        { "random", BENCH_RANDOM_SIZE, bench_random },
+        { "zeros", BENCH_ZEROS_SIZE, bench_zeros },
+    };
+
+    xs_rng_t rng;
+    xs_init (rng, 0x554C5A00);
+    bool ok = true;
+    for (unsigned i = 0; i < BENCH_CORPUS_SIZE; i++)
+    {
+        corpus [i].name = pieces [i].name;
+        corpus [i].size = pieces [i].size;
+        corpus [i].data = ok ? malloc (pieces [i].size + BENCH_SLACK) : NULL;
+        if (corpus [i].data)
+            pieces [i].gen (corpus [i].data, pieces [i].size, rng);
+        else
+            ok = false;
+    }
+
+    return ok;
+}
+
+void bench_corpus_free (bench_data_t *corpus)
+{
+    for (unsigned i = 0; i < BENCH_CORPUS_SIZE; i++)
+    {
+        free (corpus [i].data);
+        corpus [i].data = NULL;
+    }
+}
+
+static double bench_clock (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// Decompress a block with the decompressor matching compression flags
+static bool bench_decompress (const bench_opts_t *opts, const void *idata, unsigned isize,
+                              void *odata, unsigned *osize)
+{
+    if (opts->level & ULZ_FLAG_LARGE)
+        return ulz_decompress_large (idata, isize, odata, osize,
+                                     (opts->level & ULZ_FLAG_HUFF) != 0);
+    if (opts->level & ULZ_FLAG_HUFF)
+        return ulz_decompress_huff (idata, isize, odata, osize);
+    if (opts->level & ULZ_FLAG_REPOFS)
+        return ulz_decompress_rep (idata, isize, odata, osize);
+    if (opts->fast)
+        return ulz_decompress_fast (idata, isize, odata, osize);
+    return ulz_decompress (idata, isize, odata, osize);
+}
+
+/**
+ * Feed the decompressor with truncated and corrupt copies of a block.
+ * Every damaged copy is allocated separately with its exact size,
+ * so that reads past the end are caught by address sanitizer.
+ * @param errors Receives the number of times decompressor wrote
+ *      outside the output buffer
+ * @return false if there's not enough memory
+ */
+static bool bench_fuzz (const bench_opts_t *opts, const uint8_t *cdata, unsigned csize,
+                        unsigned size, xs_rng_t rng, unsigned *errors)
+{
+    uint8_t *out = malloc (size + BENCH_GUARD);
+    if (!out)
+        return false;
+
+    *errors = 0;
+    for (unsigned i = 0; i < opts->fuzz; i++)
+    {
+        unsigned xsize = csize;
+        unsigned kind = xs_rand (rng) % 3;
+        if (kind == 0)
+            xsize = xs_rand (rng) % csize;
+
+        uint8_t *x = malloc (xsize ? xsize : 1);
+        if (!x)
+        {
+            free (out);
+            return false;
+        }
+        memcpy (x, cdata, xsize);
+        if (kind == 1)
+        {
+            // A few flipped bits
+            for (unsigned n = 1 + xs_rand (rng) % 3; n; n--)
+                x [xs_rand (rng) % xsize] ^= 1 << (xs_rand (rng) & 7);
+        }
+        else if (kind == 2)
+        {
+            // A run of garbage
+            unsigned at = xs_rand (rng) % xsize;
+            for (unsigned n = MIN (xsize - at, 1 + xs_rand (rng) % 16); n; n--)
+                x [at++] = xs_rand (rng);
+        }
+
+        // Sometimes the output buffer is too small, too
+        unsigned limit = (xs_rand (rng) & 3) ? size : xs_rand (rng) % (size + 1);
+        unsigned osize = limit;
+        memset (out + limit, BENCH_GUARD_FILL, BENCH_GUARD);
+
+        bool ok = bench_decompress (opts, x, xsize, out, &osize);
+        free (x);
+
+        bool bad = ok && (osize > limit);
+        for (unsigned j = 0; j < BENCH_GUARD; j++)
+            if (out [limit + j] != BENCH_GUARD_FILL)
+                bad = true;
+        if (bad)
+            (*errors)++;
+    }
+
+    free (out);
+    return true;
+}
+
+bool bench (const bench_data_t *data, unsigned count, const bench_opts_t *opts)
+{
+    void *workmem = malloc (opts->workmem);
+    if (!workmem)
+    {
+        printf ("Not enough memory for %u bytes of match finder memory\n", opts->workmem);
+        return false;
+    }
+
+    double min_time = opts->min_time * 1e-3;
+    double total_ctime = 0, total_dtime = 0;
+    uint64_t total_size = 0, total_csize = 0;
+    bool ret = true;
+
+    xs_rng_t rng;
+    xs_init (rng, 0x554C5A01);
+
+    printf ("%-16s %10s %10s %7s %10s %10s  %s\n",
+            "name", "size", "packed", "ratio", "comp MB/s", "dec MB/s", "check");
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        const bench_data_t *bd = &data [i];
+        unsigned bound = ULZ_COMPRESS_BOUND (bd->size);
+        uint8_t *cdata = malloc (bound);
+        uint8_t *ddata = malloc (bd->size + 1);
+        unsigned csize = 0, dsize = 0;
+        unsigned reps = 0;
+        double start, ctime = 0, dtime = 0;
+        unsigned errors = 0;
+        bool ok = cdata && ddata;
+
+        if (ok)
+        {
+            start = bench_clock ();
+            do
+            {
+                csize = bound;
+                ok = ulz_compress_wm (bd->data, bd->size, cdata, &csize,
+                                      workmem, opts->workmem, opts->level);
+                reps++;
+                ctime = bench_clock () - start;
+            } while (ok && (ctime < min_time));
+            ctime /= reps;
+        }
+
+        if (ok)
+        {
+            reps = 0;
+            start = bench_clock ();
+            do
+            {
+                dsize = bd->size + 1;
+                ok = bench_decompress (opts, cdata, csize, ddata, &dsize);
+                reps++;
+                dtime = bench_clock () - start;
+            } while (ok && (dtime < min_time));
+            dtime /= reps;
+        }
+
+        const char *check;
+        char fuzz_check [24];
+        if (!cdata || !ddata)
+            check = "NOT ENOUGH MEMORY";
+        else if (!ok || (dsize != bd->size) || (memcmp (bd->data, ddata, dsize) != 0))
+            check = "ROUND TRIP FAILED";
+        else if ((opts->level & (ULZ_FLAG_REPOFS | ULZ_FLAG_HUFF | ULZ_FLAG_LARGE)) &&
+                 ulz_decompress (cdata, csize, ddata, &dsize))
+            // blocks in format variants must not pass for plain ones
+            check = "PLAIN DECODER ACCEPTED";
+        else if (!bench_fuzz (opts, cdata, csize, bd->size, rng, &errors))
+            check = "NOT ENOUGH MEMORY";
+        else
+        {
+            snprintf (fuzz_check, sizeof (fuzz_check), "%u/%u FUZZ FAILED", errors, opts->fuzz);
+            check = errors ? fuzz_check : "ok";
+        }
+        if (check [0] != 'o')
+            ret = false;
+
+        ctime = MAX (ctime, 1e-9);
+        dtime = MAX (dtime, 1e-9);
+        printf ("%-16.16s %10u %10u %6.2f%% %10.2f %10.2f  %s\n",
+                bd->name, bd->size, csize, bd->size ? csize * 100.0 / bd->size : 100.0,
+                bd->size / ctime * 1e-6, bd->size / dtime * 1e-6, check);
+
+        total_size += bd->size;
+        total_csize += csize;
+        total_ctime += ctime;
+        total_dtime += dtime;
+
+        free (ddata);
+        free (cdata);
+    }
+
+    if (count > 1)
+        printf ("%-16s %10llu %10llu %6.2f%% %10.2f %10.2f  %s\n",
+                "total", (unsigned long long)total_size, (unsigned long long)total_csize,
+                total_size ? total_csize * 100.0 / total_size : 100.0,
+                total_size / MAX (total_ctime, 1e-9) * 1e-6,
+                total_size / MAX (total_dtime, 1e-9) * 1e-6,
+                ret ? "ok" : "FAILED");
+
+    free (workmem);
+    return ret;
+}
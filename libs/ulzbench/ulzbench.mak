@@ -0,0 +1,12 @@
+# uLZ benchmark and synthetic corpus, shared by the ulz tool and tests
+
+ifeq ($(TOOLKIT)-$(filter none-eabi,$(TARGET)),GCC-)
+
+LIBS += ulzbench
+DESCRIPTION.ulzbench = uLZ benchmark and synthetic corpus for host tools and tests
+TARGETS.ulzbench = ulzbench$L
+
+SRC.ulzbench$L := $(wildcard libs/ulzbench/*.c)
+LIBS.ulzbench$L := useful$L
+
+endif
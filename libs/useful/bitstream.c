@@ -72,6 +72,48 @@ uint32_t bs_read_bits (bitstream_t *bs, unsigned bits)
 
 // -------------------------------------------------------------------------- //
 
+void br_init (bitreader_t *br, const void *buff, unsigned size)
+{
+    br->ptr = (const uint8_t *)buff;
+    br->end = br->ptr + size;
+    br->acc = 0;
+    br->acc_bits = 0;
+    br->forward = false;
+    br->exhausted = false;
+}
+
+void br_init_fwd (bitreader_t *br, const void *buff, unsigned size)
+{
+    br_init (br, buff, size);
+    br->forward = true;
+}
+
+bool br_read_bytes (bitreader_t *br, void *dst, unsigned size)
+{
+    if (br->forward)
+    {
+        // drop the rest of current byte, whole bytes go back to stream
+        br->ptr -= br->acc_bits >> 3;
+        br->acc = 0;
+        br->acc_bits = 0;
+    }
+
+    if (size > br_avail (br))
+    {
+        br->exhausted = true;
+        return false;
+    }
+
+    memcpy (dst, br->ptr, size);
+    if (br->forward)
+        br->ptr += size;
+    else
+        br_skip_bytes (br, size);
+    return true;
+}
+
+// -------------------------------------------------------------------------- //
+
 bool bs_write_bytes (bitstream_t *bs, const void *src, unsigned size)
 {
     uint8_t *ptr = bs->ptr + size;
@@ -92,9 +134,10 @@ bool bs_write_bits (bitstream_t *bs, unsigned bits, uint32_t val)
     while (bits != 0)
     {
         unsigned copy_bits = MIN (32 - acc_bits, bits);
-        acc |= (uint32_t)(val & MASK (copy_bits)) << acc_bits;
+        // copy_bits may be 32, and shifting by it is undefined
+        acc |= (uint32_t)(val & (0xFFFFFFFFU >> (32 - copy_bits))) << acc_bits;
         acc_bits += copy_bits;
-        val >>= copy_bits;
+        val = (copy_bits < 32) ? (val >> copy_bits) : 0;
         bits -= copy_bits;
 
         while (acc_bits >= 8)
@@ -135,8 +178,8 @@ unsigned bs_write_finish (bitstream_t *bs, void *buff, unsigned size)
     uint8_t *start = (uint8_t *)buff;
     unsigned bits_size = start + size - end;
     uint8_t *ptr = bs->ptr;
-    while (bits_size--)
-        *ptr++ = *end++;
+    memmove (ptr, end, bits_size);
+    ptr += bits_size;
 
     // make bitstream ready for reading, just in case
     bs->ptr = start;
@@ -144,3 +187,155 @@ unsigned bs_write_finish (bitstream_t *bs, void *buff, unsigned size)
 
     return ptr - start;
 }
+
+// -------------------------------------------------------------------------- //
+
+void bw_init (bitwriter_t *bw, void *buff, unsigned size)
+{
+    bw->start = (uint8_t *)buff;
+    bw->size = size;
+    bw->ptr = bw->start;
+    bw->end = bw->start + size;
+    bw->acc = 0;
+    bw->acc_bits = 0;
+    bw->done = 0;
+    bw->output = NULL;
+    bw->ctx = NULL;
+    bw->forward = false;
+    bw->exhausted = false;
+}
+
+void bw_init_fwd (bitwriter_t *bw, void *buff, unsigned size,
+                  bw_output_t output, void *ctx)
+{
+    bw_init (bw, buff, size);
+    bw->output = output;
+    bw->ctx = ctx;
+    bw->forward = true;
+}
+
+/// Pass buffer contents to output callback in forward format
+static bool bw_output (bitwriter_t *bw)
+{
+    unsigned size = bw->ptr - bw->start;
+    if (size && !bw->output (bw->ctx, bw->start, size))
+    {
+        bw->exhausted = true;
+        return false;
+    }
+
+    bw->done += size;
+    bw->ptr = bw->start;
+    return true;
+}
+
+bool __bw_flush_slow (bitwriter_t *bw)
+{
+    if (bw->forward && bw->output && !bw_output (bw))
+        return false;
+
+    for (; bw->acc_bits >= 8; bw->acc_bits -= 8, bw->acc >>= 8)
+    {
+        if (bw->end <= bw->ptr)
+        {
+            bw->exhausted = true;
+            return false;
+        }
+
+        if (bw->forward)
+            *bw->ptr++ = bw->acc;
+        else
+            *(--bw->end) = bw->acc;
+    }
+
+    return true;
+}
+
+bool bw_write_fields (bitwriter_t *bw, const uint32_t *vals,
+                      const uint8_t *widths, unsigned n)
+{
+    // Work on a copy, so that the compiler may keep it in registers
+    bitwriter_t w = *bw;
+    bool ok = true;
+    for (unsigned i = 0; i < n; i++)
+        if (!bw_write_bits (&w, widths [i], vals [i]))
+        {
+            ok = false;
+            break;
+        }
+
+    *bw = w;
+    return ok;
+}
+
+/// Write out all bits, padding the last byte with zeros
+static bool bw_flush_all (bitwriter_t *bw)
+{
+    // make room first, so that rounding up does not fill the reservoir
+    if (!__bw_flush (bw))
+        return false;
+    bw->acc_bits = (bw->acc_bits + 7) & ~7;
+    return __bw_flush (bw);
+}
+
+bool bw_write_bytes (bitwriter_t *bw, const void *src, unsigned size)
+{
+    const uint8_t *cur = (const uint8_t *)src;
+    if (!bw->forward)
+    {
+        if (size > (unsigned)(bw->end - bw->ptr))
+        {
+            bw->exhausted = true;
+            return false;
+        }
+
+        memcpy (bw->ptr, cur, size);
+        bw->ptr += size;
+        return true;
+    }
+
+    // Bytes go after all bits written so far
+    if (!bw_flush_all (bw))
+        return false;
+
+    while (size)
+    {
+        if (bw->ptr >= bw->end)
+        {
+            if (!bw->output)
+            {
+                bw->exhausted = true;
+                return false;
+            }
+            if (!bw_output (bw))
+                return false;
+        }
+
+        unsigned n = MIN (size, (unsigned)(bw->end - bw->ptr));
+        memcpy (bw->ptr, cur, n);
+        bw->ptr += n;
+        cur += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+unsigned bw_finish (bitwriter_t *bw)
+{
+    if (bw->exhausted || !bw_flush_all (bw))
+        return 0;
+
+    if (bw->forward)
+    {
+        if (bw->output && !bw_output (bw))
+            return 0;
+        return bw->done + (bw->ptr - bw->start);
+    }
+
+    // Move bit substream down to the end of byte substream
+    unsigned bits_size = bw->start + bw->size - bw->end;
+    memmove (bw->ptr, bw->end, bits_size);
+
+    return bw->ptr + bits_size - bw->start;
+}
@@ -31,16 +31,59 @@ void *CLIKE_P (memcpy) (void *dest, const void *src, size_t len)
     }
     // now d is guaranteed to be aligned, len is guaranteed to be >0
 
-    // if s is aligned too, compare by words
+    // if s is aligned too, copy by words, four at a time while possible
     if ((((uintptr_t)s) & LONG_ALIGN_MASK) == 0)
+    {
+        while (len >= 4 * __SIZEOF_LONG__)
+        {
+            unsigned long w0 = ((const unsigned long *)s) [0];
+            unsigned long w1 = ((const unsigned long *)s) [1];
+            unsigned long w2 = ((const unsigned long *)s) [2];
+            unsigned long w3 = ((const unsigned long *)s) [3];
+            ((unsigned long *)d) [0] = w0;
+            ((unsigned long *)d) [1] = w1;
+            ((unsigned long *)d) [2] = w2;
+            ((unsigned long *)d) [3] = w3;
+
+            d += 4 * __SIZEOF_LONG__;
+            s += 4 * __SIZEOF_LONG__;
+            len -= 4 * __SIZEOF_LONG__;
+        }
+
         while (len >= __SIZEOF_LONG__)
         {
-            *(long *)d = *(const long *)s;
+            *(unsigned long *)d = *(const unsigned long *)s;
 
             d += __SIZEOF_LONG__;
             s += __SIZEOF_LONG__;
             len -= __SIZEOF_LONG__;
         }
+    }
+    else if (len >= __SIZEOF_LONG__)
+    {
+        // Read aligned words from s and merge every two of them into one.
+        // Words are never read past the one containing the last byte copied.
+        unsigned offs = ((uintptr_t)s) & LONG_ALIGN_MASK;
+        unsigned rshift = offs * 8;
+        unsigned lshift = __SIZEOF_LONG__ * 8 - rshift;
+        const unsigned long *ws = (const unsigned long *)(s - offs);
+        unsigned long w0 = *ws++;
+
+        do
+        {
+            unsigned long w1 = *ws++;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            *(unsigned long *)d = (w0 >> rshift) | (w1 << lshift);
+#else
+            *(unsigned long *)d = (w0 << rshift) | (w1 >> lshift);
+#endif
+            w0 = w1;
+
+            d += __SIZEOF_LONG__;
+            s += __SIZEOF_LONG__;
+            len -= __SIZEOF_LONG__;
+        } while (len >= __SIZEOF_LONG__);
+    }
 #endif
 
     // Copy the remaining bytes by one
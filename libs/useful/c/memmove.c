@@ -0,0 +1,139 @@
+/*
+    Optimized C implementation for memmove()
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+
+#define LONG_ALIGN_MASK (__SIZEOF_LONG__ - 1)
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define MERGE(lo, hi, rshift, lshift) (((lo) >> (rshift)) | ((hi) << (lshift)))
+#else
+#  define MERGE(lo, hi, rshift, lshift) (((lo) << (rshift)) | ((hi) >> (lshift)))
+#endif
+
+/// Copy from lower addresses to higher, safe if dest is below src
+static void copy_forward (uint8_t *d, const uint8_t *s, size_t len)
+{
+#if USEFUL_OPTIMIZE == 1
+    if (len >= 2 * __SIZEOF_LONG__)
+    {
+        // Proceed byte by byte up to nearest long boundary
+        while (((uintptr_t)d) & LONG_ALIGN_MASK)
+        {
+            *d++ = *s++;
+            len--;
+        }
+
+        unsigned offs = ((uintptr_t)s) & LONG_ALIGN_MASK;
+        if (offs == 0)
+            do
+            {
+                *(unsigned long *)d = *(const unsigned long *)s;
+
+                d += __SIZEOF_LONG__;
+                s += __SIZEOF_LONG__;
+                len -= __SIZEOF_LONG__;
+            } while (len >= __SIZEOF_LONG__);
+        else
+        {
+            // Every word is read before the one below it is written over
+            unsigned rshift = offs * 8;
+            unsigned lshift = __SIZEOF_LONG__ * 8 - rshift;
+            const unsigned long *ws = (const unsigned long *)(s - offs);
+            unsigned long lo = *ws++;
+
+            do
+            {
+                unsigned long hi = *ws++;
+                *(unsigned long *)d = MERGE (lo, hi, rshift, lshift);
+                lo = hi;
+
+                d += __SIZEOF_LONG__;
+                s += __SIZEOF_LONG__;
+                len -= __SIZEOF_LONG__;
+            } while (len >= __SIZEOF_LONG__);
+        }
+    }
+#endif
+
+    while (len != 0)
+    {
+        *d++ = *s++;
+        len--;
+    }
+}
+
+/// Copy from higher addresses to lower, safe if dest is above src
+static void copy_backward (uint8_t *d, const uint8_t *s, size_t len)
+{
+    // d and s point past the end of both areas from now on
+    d += len;
+    s += len;
+
+#if USEFUL_OPTIMIZE == 1
+    if (len >= 2 * __SIZEOF_LONG__)
+    {
+        // Proceed byte by byte down to nearest long boundary
+        while (((uintptr_t)d) & LONG_ALIGN_MASK)
+        {
+            *--d = *--s;
+            len--;
+        }
+
+        unsigned offs = ((uintptr_t)s) & LONG_ALIGN_MASK;
+        if (offs == 0)
+            do
+            {
+                d -= __SIZEOF_LONG__;
+                s -= __SIZEOF_LONG__;
+                len -= __SIZEOF_LONG__;
+
+                *(unsigned long *)d = *(const unsigned long *)s;
+            } while (len >= __SIZEOF_LONG__);
+        else
+        {
+            // Every word is read before the one above it is written over
+            unsigned rshift = offs * 8;
+            unsigned lshift = __SIZEOF_LONG__ * 8 - rshift;
+            const unsigned long *ws = (const unsigned long *)(s - offs);
+            unsigned long hi = *ws;
+
+            do
+            {
+                unsigned long lo = *--ws;
+                d -= __SIZEOF_LONG__;
+                *(unsigned long *)d = MERGE (lo, hi, rshift, lshift);
+                hi = lo;
+
+                s -= __SIZEOF_LONG__;
+                len -= __SIZEOF_LONG__;
+            } while (len >= __SIZEOF_LONG__);
+        }
+    }
+#endif
+
+    while (len != 0)
+    {
+        *--d = *--s;
+        len--;
+    }
+}
+
+void *CLIKE_P (memmove) (void *dest, const void *src, size_t len)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    // Unsigned difference is less than len only if dest is inside src area
+    if ((size_t)(d - s) >= len)
+        copy_forward (d, s, len);
+    else if (d != s)
+        copy_backward (d, s, len);
+
+    return dest;
+}
@@ -0,0 +1,15 @@
+/*
+    A library of generally useful functions
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "../leb128_priv.h"
+
+unsigned uleb128_array (const uint8_t **data, const uint8_t *end,
+                        uint32_t *values, unsigned count)
+{
+    return uleb128_array_words (data, end, values, count);
+}
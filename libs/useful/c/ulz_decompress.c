@@ -9,37 +9,11 @@
 #include "useful/clike.h"
 #include "useful/ulz.h"
 #include "useful/bitstream.h"
-#include "ulz_priv.h"
+#include "../ulz_priv.h"
 
 // Uncomment for noisy compressor debugging
 //#define NOISY
 
-static unsigned ulz_read_uleb128 (const uint8_t **idata, unsigned isize)
-{
-    // this is like uleb128() but with a few additional sanity checks
-    unsigned d, r = 0;
-    unsigned shift = 0;
-    const uint8_t *src = *idata;
-    const uint8_t *end = src + isize;
-
-    do
-    {
-        if (src >= end)
-            return 0;
-
-        d = *src++;
-        r |= (d & 0x7F) << shift;
-        shift += 7;
-
-        if (shift > 7 * 5)
-            return 0;
-    } while (d & 0x80);
-
-    *idata = src;
-
-    return r;
-}
-
 unsigned ulz_decompress_size (const void *idata, unsigned isize)
 {
     const uint8_t *src = (const uint8_t *)idata;
@@ -77,8 +51,8 @@ static bool ulz16u_read (bitstream_t *bs, uint32_t *value)
     return !bs->exhausted;
 }
 
-bool ulz_decompress (const void *idata, unsigned isize,
-                     void *odata, unsigned *osize)
+bool ulz_decompress_block (const void *idata, unsigned isize,
+                           const void *hist, void *odata, unsigned *osize)
 {
     bitstream_t ibs;
     bs_init (&ibs, (void *)idata, isize);
@@ -98,14 +72,27 @@ bool ulz_decompress (const void *idata, unsigned isize,
         uint32_t lit_len;
         if (!ulz16u_read (&ibs, &lit_len) ||
             (cur + lit_len > end) ||
-            !bs_read_bytes (&ibs, cur, lit_len))
+            (lit_len > (unsigned)(ibs.end - ibs.ptr)))
             return false;
 
 #ifdef NOISY
-        printf ("LIT: [%.*s]\n", lit_len, cur);
+        printf ("LIT: [%.*s]\n", lit_len, ibs.ptr);
 #endif
 
-        cur += lit_len;
+        // Literals (and stored blocks, which are just one long literal)
+        // go at memcpy speed, unless on in-place decompression the source
+        // is just ahead of destination: then copy forward byte by byte
+        if (((uintptr_t)ibs.ptr - (uintptr_t)cur >= lit_len) &&
+            ((uintptr_t)cur - (uintptr_t)ibs.ptr >= lit_len))
+        {
+            memcpy (cur, ibs.ptr, lit_len);
+            cur += lit_len;
+            ibs.ptr += lit_len;
+        }
+        else
+            while (lit_len--)
+                *cur++ = *ibs.ptr++;
+
         if (cur >= end)
             break;
 
@@ -115,6 +102,8 @@ bool ulz_decompress (const void *idata, unsigned isize,
             !ulz16u_read (&ibs, &ref_ofs))
             return false;
         ref_ofs += 1;
+        if ((ref_ofs == 0) || (ref_ofs > (unsigned)(cur - (const uint8_t *)hist)))
+            return false;
 
 #ifdef NOISY
         printf ("REF: [%.*s] <- %u\n", ref_len, cur - ref_ofs, ref_ofs);
@@ -129,3 +118,9 @@ bool ulz_decompress (const void *idata, unsigned isize,
 
     return true;
 }
+
+bool ulz_decompress (const void *idata, unsigned isize,
+                     void *odata, unsigned *osize)
+{
+    return ulz_decompress_block (idata, isize, odata, odata, osize);
+}
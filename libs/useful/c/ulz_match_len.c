@@ -0,0 +1,25 @@
+/*
+    uLZ compression library
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "../ulz_priv.h"
+
+/* Most targets inline the byte loop from ulz_priv.h, and this file
+ * compiles to nothing. It is only needed when the compiler expects
+ * ulz_match_len() out of line, but the build has not selected a faster
+ * version, e.g. an x86_64 compiler with another ARCH.
+ */
+#ifdef ULZ_MATCH_LEN_EXTERN
+unsigned ulz_match_len (const uint8_t *a, const uint8_t *b, unsigned max_len)
+{
+    unsigned len;
+    for (len = 0; (len < max_len) && (a [len] == b [len]); len++)
+        ;
+    return len;
+}
+#endif
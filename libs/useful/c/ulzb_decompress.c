@@ -0,0 +1,95 @@
+/*
+    uLZB decompression library
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulzb.h"
+#include "../ulz_priv.h"
+
+/// Add length extension bytes to len, return false on broken data
+INLINE_ALWAYS bool ulzb_read_ext (const uint8_t **src, const uint8_t *send,
+                                  unsigned *len, unsigned max)
+{
+    if (*len != ULZB_NIBBLE_MAX)
+        return true;
+
+    unsigned b;
+    do
+    {
+        if (*src >= send)
+            return false;
+        b = *(*src)++;
+        *len += b;
+        if (*len > max)
+            return false;
+    } while (b == 255);
+
+    return true;
+}
+
+bool ulzb_decompress (const void *idata, unsigned isize,
+                      void *odata, unsigned *osize)
+{
+    const uint8_t *src = (const uint8_t *)idata;
+    const uint8_t *send = src + isize;
+
+    unsigned dec_size = ulz_read_uleb128 (&src, isize);
+    if (dec_size > *osize)
+        // either broken compressed stream, or not enough big buffer
+        return false;
+
+    uint8_t *start = (uint8_t *)odata;
+    uint8_t *cur = start;
+    uint8_t *end = cur + dec_size;
+    *osize = dec_size;
+
+    while (cur < end)
+    {
+        if (src >= send)
+            return false;
+
+        unsigned token = *src++;
+        unsigned len = token >> 4;
+        if (!ulzb_read_ext (&src, send, &len, end - cur) ||
+            (len > (unsigned)(end - cur)) ||
+            (len > (unsigned)(send - src)))
+            return false;
+
+        memcpy (cur, src, len);
+        cur += len;
+        src += len;
+
+        if (cur >= end)
+            break;
+
+        if (send - src < 2)
+            return false;
+
+        unsigned ofs = src [0] | (src [1] << 8);
+        src += 2;
+        if ((ofs == 0) || (ofs > (unsigned)(cur - start)))
+            return false;
+
+        len = token & ULZB_NIBBLE_MAX;
+        if (!ulzb_read_ext (&src, send, &len, end - cur) ||
+            ((len += ULZB_MINMATCH) > (unsigned)(end - cur)))
+            return false;
+
+        // Overlapping references must be copied byte by byte
+        const uint8_t *ref = cur - ofs;
+        if (ofs >= len)
+        {
+            memcpy (cur, ref, len);
+            cur += len;
+        }
+        else
+            while (len--)
+                *cur++ = *ref++;
+    }
+
+    return true;
+}
@@ -10,17 +10,21 @@
 
 uint32_t ip_crc_block (uint32_t sum, const void *data, unsigned len)
 {
+    // 32 bits would overflow after 128 KiB of data and lose the carries
+    uint64_t acc = sum;
     while (len > 1)
     {
-        sum += GET_UINT16_BE (data, 0);
+        acc += GET_UINT16_BE (data, 0);
         data = ((uint16_t *)data) + 1;
         len -= 2;
     }
 
     if (len > 0)
-        sum += *(uint8_t *)data;
+        acc += *(uint8_t *)data;
 
-    return sum;
+    // 2^32 is 1 modulo 0xffff, so the end-around carry keeps the checksum
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    return (uint32_t)acc + (uint32_t)(acc >> 32);
 }
 
 uint16_t ip_crc_fin (uint32_t sum)
@@ -17,7 +17,9 @@ uint32_t uleb128 (const uint8_t **data)
     do
     {
         d = *(*data)++;
-        r |= (d & 0x7F) << shift;
+        // bits that don't fit are dropped
+        if (shift < 32)
+            r |= (d & 0x7F) << shift;
         shift += 7;
     } while (d & 0x80);
 
@@ -27,13 +29,14 @@ uint32_t uleb128 (const uint8_t **data)
 int32_t sleb128 (const uint8_t **data)
 {
     uint32_t d;
-    int32_t r = 0;
+    uint32_t r = 0;
     unsigned shift = 0;
 
     do
     {
         d = *(*data)++;
-        r |= (d & 0x7F) << shift;
+        if (shift < 32)
+            r |= (d & 0x7F) << shift;
         shift += 7;
     } while (d & 0x80);
 
@@ -42,3 +45,217 @@ int32_t sleb128 (const uint8_t **data)
 
     return r;
 }
+
+uint64_t uleb128_64 (const uint8_t **data)
+{
+    uint32_t d;
+    uint64_t r = 0;
+    unsigned shift = 0;
+
+    do
+    {
+        d = *(*data)++;
+        if (shift < 64)
+            r |= (uint64_t)(d & 0x7F) << shift;
+        shift += 7;
+    } while (d & 0x80);
+
+    return r;
+}
+
+int64_t sleb128_64 (const uint8_t **data)
+{
+    uint32_t d;
+    uint64_t r = 0;
+    unsigned shift = 0;
+
+    do
+    {
+        d = *(*data)++;
+        if (shift < 64)
+            r |= (uint64_t)(d & 0x7F) << shift;
+        shift += 7;
+    } while (d & 0x80);
+
+    if ((d & 0x40) && (shift < 64))
+        r |= 0xffffffffffffffffULL << shift;
+
+    return r;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool uleb128_n (const uint8_t **data, const uint8_t *end, uint32_t *value)
+{
+    const uint8_t *src = *data;
+    uint32_t d;
+    uint32_t r = 0;
+    unsigned shift = 0;
+
+    do
+    {
+        if ((src >= end) || (shift >= 7 * LEB128_MAX_32))
+            return false;
+
+        d = *src++;
+        r |= (d & 0x7F) << shift;
+        shift += 7;
+    } while (d & 0x80);
+
+    // last byte of a 5-byte number has only 4 bits that fit
+    if ((shift == 7 * LEB128_MAX_32) && (d > 0x0F))
+        return false;
+
+    *data = src;
+    *value = r;
+    return true;
+}
+
+bool sleb128_n (const uint8_t **data, const uint8_t *end, int32_t *value)
+{
+    const uint8_t *src = *data;
+    uint32_t d;
+    uint32_t r = 0;
+    unsigned shift = 0;
+
+    do
+    {
+        if ((src >= end) || (shift >= 7 * LEB128_MAX_32))
+            return false;
+
+        d = *src++;
+        r |= (d & 0x7F) << shift;
+        shift += 7;
+    } while (d & 0x80);
+
+    if (shift < 32)
+    {
+        if (d & 0x40)
+            r |= 0xffffffffU << shift;
+    }
+    // bits of the last byte that don't fit must be copies of the sign bit
+    else if ((d > 0x07) && (d < 0x78))
+        return false;
+
+    *data = src;
+    *value = r;
+    return true;
+}
+
+bool uleb128_64_n (const uint8_t **data, const uint8_t *end, uint64_t *value)
+{
+    const uint8_t *src = *data;
+    uint32_t d;
+    uint64_t r = 0;
+    unsigned shift = 0;
+
+    do
+    {
+        if ((src >= end) || (shift >= 7 * LEB128_MAX_64))
+            return false;
+
+        d = *src++;
+        r |= (uint64_t)(d & 0x7F) << shift;
+        shift += 7;
+    } while (d & 0x80);
+
+    // last byte of a 10-byte number has only 1 bit that fits
+    if ((shift == 7 * LEB128_MAX_64) && (d > 0x01))
+        return false;
+
+    *data = src;
+    *value = r;
+    return true;
+}
+
+bool sleb128_64_n (const uint8_t **data, const uint8_t *end, int64_t *value)
+{
+    const uint8_t *src = *data;
+    uint32_t d;
+    uint64_t r = 0;
+    unsigned shift = 0;
+
+    do
+    {
+        if ((src >= end) || (shift >= 7 * LEB128_MAX_64))
+            return false;
+
+        d = *src++;
+        r |= (uint64_t)(d & 0x7F) << shift;
+        shift += 7;
+    } while (d & 0x80);
+
+    if (shift < 64)
+    {
+        if (d & 0x40)
+            r |= 0xffffffffffffffffULL << shift;
+    }
+    // bits of the last byte that don't fit must be copies of the sign bit
+    else if ((d != 0x00) && (d != 0x7F))
+        return false;
+
+    *data = src;
+    *value = r;
+    return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+uint8_t *put_uleb128 (uint8_t *data, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *data++ = value | 0x80;
+        value >>= 7;
+    }
+
+    *data++ = value;
+    return data;
+}
+
+uint8_t *put_sleb128 (uint8_t *data, int32_t value)
+{
+    for (;;)
+    {
+        uint8_t chip = value & 0x7F;
+        // arithmetic shift keeps the sign
+        value >>= 7;
+        if (((value == 0) && !(chip & 0x40)) ||
+            ((value == -1) && (chip & 0x40)))
+        {
+            *data++ = chip;
+            return data;
+        }
+
+        *data++ = chip | 0x80;
+    }
+}
+
+uint8_t *put_uleb128_64 (uint8_t *data, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *data++ = value | 0x80;
+        value >>= 7;
+    }
+
+    *data++ = value;
+    return data;
+}
+
+uint8_t *put_sleb128_64 (uint8_t *data, int64_t value)
+{
+    for (;;)
+    {
+        uint8_t chip = value & 0x7F;
+        value >>= 7;
+        if (((value == 0) && !(chip & 0x40)) ||
+            ((value == -1) && (chip & 0x40)))
+        {
+            *data++ = chip;
+            return data;
+        }
+
+        *data++ = chip | 0x80;
+    }
+}
@@ -0,0 +1,96 @@
+/*
+    LEB128 decoding internals
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#ifndef _LEB128_PRIV_H
+#define _LEB128_PRIV_H
+
+#include "useful/clike.h"
+#include "useful/usefun.h"
+
+#if __UINTPTR_MAX__ == __UINT64_MAX__
+/// Machine word, LEB128 values are looked for a word at a time
+typedef uint64_t leb128_word_t;
+#  define leb128_ctz(x)         __builtin_ctzll (x)
+#  define leb128_bswap(x)       __builtin_bswap64 (x)
+#else
+typedef uint32_t leb128_word_t;
+#  define leb128_ctz(x)         __builtin_ctz (x)
+#  define leb128_bswap(x)       bswap32 (x)
+#endif
+
+/// High bit of every byte in a word
+#define LEB128_HIGH_BITS        ((leb128_word_t)0x8080808080808080ULL)
+
+/**
+ * Decode an uleb128 if it ends within a word at @a data,
+ * which must be readable as a whole.
+ *
+ * @param data Encoded data
+ * @param value Receives the decoded number
+ * @return Encoded number size, or 0 if the number is longer
+ *      than a word or does not fit into 32 bits
+ */
+INLINE_ALWAYS unsigned uleb128_word (const uint8_t *data, uint32_t *value)
+{
+    leb128_word_t w;
+    memcpy (&w, data, sizeof (w));
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    w = leb128_bswap (w);
+#endif
+
+    // the first byte with high bit clear is the last one of value
+    leb128_word_t stop = ~w & LEB128_HIGH_BITS;
+    if (!stop)
+        return 0;
+    unsigned len = (leb128_ctz (stop) >> 3) + 1;
+    if (len > LEB128_MAX_32)
+        return 0;
+
+    // drop following bytes, then gather 7-bit groups together
+    w &= ((leb128_word_t)2 << (len * 8 - 1)) - 1;
+    uint32_t v = (w & 0x7F) | ((w >> 1) & 0x3F80) |
+        ((w >> 2) & 0x1FC000) | ((w >> 3) & 0xFE00000);
+#if __UINTPTR_MAX__ == __UINT64_MAX__
+    // last byte of a 5-byte number has only 4 bits that fit
+    if (w >> 36)
+        return 0;
+    v |= (w >> 4) & 0xF0000000;
+#endif
+
+    *value = v;
+    return len;
+}
+
+/**
+ * Decode uleb128 numbers a word at a time while there's a word
+ * of data left, then byte by byte. Same as uleb128_array().
+ */
+INLINE_ALWAYS unsigned uleb128_array_words (const uint8_t **data, const uint8_t *end,
+                                            uint32_t *values, unsigned count)
+{
+    const uint8_t *src = *data;
+    unsigned i;
+    for (i = 0; i < count; i++)
+    {
+        unsigned len;
+        // one-byte numbers are the most common by far
+        if ((src < end) && !(*src & 0x80))
+            values [i] = *src++;
+        else if ((end - src >= (int)sizeof (leb128_word_t)) &&
+            ((len = uleb128_word (src, &values [i])) != 0))
+            src += len;
+        // longer numbers or a tail of data
+        else if (!uleb128_n (&src, end, &values [i]))
+            break;
+    }
+
+    *data = src;
+    return i;
+}
+
+#endif // _LEB128_PRIV_H
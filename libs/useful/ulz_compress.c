@@ -6,15 +6,27 @@
     you may not use this file except in compliance with the License.
 */
 
-#define _GNU_SOURCE
 #include "useful/clike.h"
 #include "useful/ulz.h"
 #include "useful/bitstream.h"
 #include "ulz_priv.h"
+#include "ulz_mf.h"
 
 // Uncomment for noisy compressor debugging
 //#define NOISY
 
+/// Optimal parser takes references this long without further thinking
+#ifndef ULZ_OPT_NICE
+#  define ULZ_OPT_NICE      256
+#endif
+/// Maximal optimal parser segment length
+#ifndef ULZ_OPT_SEG_MAX
+#  define ULZ_OPT_SEG_MAX   16384
+#endif
+/// With shorter segments (and less memory left for match finder)
+/// optimal parser is not better than lazy one
+#define ULZ_OPT_SEG_MIN     1024
+
 /// Return number of bits used to encode specified value
 INLINE_ALWAYS unsigned ulz16u_bits (unsigned value)
 {
@@ -30,7 +42,7 @@ INLINE_ALWAYS unsigned ulz16u_bits (unsigned value)
     return ULZ16U_111_BITS + 32;
 }
 
-static bool ulz16u_write (bitstream_t *bs, unsigned value)
+static bool ulz16u_write (bitwriter_t *bs, unsigned value)
 {
     unsigned bits;
     if (value < ULZ16U_10_LOW)
@@ -58,113 +70,608 @@ static bool ulz16u_write (bitstream_t *bs, unsigned value)
         uint32_t val32 = UINT32_LE (value);
         value = ((ULZ16U_RAW32 - ULZ16U_111_LOW) << 3) | ULZ16U_111_PREFIX;
         bits = ULZ16U_111_BITS;
-        return bs_write_bits (bs, bits, value) &&
-                bs_write_bytes (bs, &val32, sizeof (val32));
+        return bw_write_bits (bs, bits, value) &&
+                bw_write_bytes (bs, &val32, sizeof (val32));
     }
 
-    return bs_write_bits (bs, bits, value);
+    return bw_write_bits (bs, bits, value);
+}
+
+static bool ulz_write_uleb128 (bitwriter_t *bs, unsigned value)
+{
+    uint8_t chips [LEB128_MAX_32];
+    return bw_write_bytes (bs, chips, put_uleb128 (chips, value) - chips);
+}
+
+/// Compressed block writer
+typedef struct
+{
+    /// Output bitstream
+    bitwriter_t bs;
+    /// Start of output buffer
+    const uint8_t *odata;
+    /// Start of input data
+    const uint8_t *idata;
+    /// How far decoded data goes ahead of consumed byte substream, at most
+    int overrun;
+    /// Use repeat offset codes
+    bool repofs;
+    /// Code offsets with ulz24u
+    bool large;
+    /// Last two reference offsets, for repeat offset codes
+    unsigned rep [2];
+    /// If not NULL, literal byte statistics is collected here
+    uint32_t *freq;
+    /// If not NULL, literal bytes are coded with this code
+    const ulz_huff_t *huff;
+} ulz_writer_t;
+
+static void ulz_writer_init (ulz_writer_t *w, void *odata, unsigned osize,
+                             const void *idata)
+{
+    bw_init (&w->bs, odata, osize);
+    w->odata = (const uint8_t *)odata;
+    w->idata = (const uint8_t *)idata;
+    w->overrun = 0;
+    w->repofs = false;
+    w->large = false;
+    w->rep [0] = w->rep [1] = 0;
+    w->freq = NULL;
+    w->huff = NULL;
 }
 
-static bool ulz_write_uleb128 (bitstream_t *bs, unsigned value)
+static bool ulz_write_literal (ulz_writer_t *w, const uint8_t *lit, unsigned len)
 {
-    uint8_t chips [5];
-    uint8_t *cur = chips;
-    for (;;)
+    if (!ulz16u_write (&w->bs, len))
+        return false;
+
+    if (w->freq)
+        for (unsigned i = 0; i < len; i++)
+            w->freq [lit [i]]++;
+
+    if (w->huff)
     {
-        uint8_t chip = value & 0x7F;
-        value >>= 7;
-        if (value)
-            chip |= 0x80;
-        *cur++ = chip;
-        if (value == 0)
-            break;
+        for (unsigned i = 0; i < len; i++)
+            if (!bw_write_bits (&w->bs, w->huff->len [lit [i]], w->huff->code [lit [i]]))
+                return false;
     }
+    else if (!bw_write_bytes (&w->bs, lit, len))
+        return false;
 
-    return bs_write_bytes (bs, chips, cur - chips);
+#ifdef NOISY
+    printf ("LIT: [%.*s]\n", len, lit);
+#endif
+
+    return true;
 }
 
-static bool ulz_write_literal (bitstream_t *bs, uint8_t *lit, unsigned len)
+/// Start the block in the literal Huffman variant of uLZ format
+static bool ulz_write_huff_table (ulz_writer_t *w)
 {
-    if (!ulz16u_write (bs, len) ||
-        !bs_write_bytes (bs, lit, len))
+    if (!bw_write_bits (&w->bs, 1, w->huff != NULL))
         return false;
+    if (!w->huff)
+        return true;
+
+    for (unsigned c = 0; c < 256; )
+    {
+        unsigned l = w->huff->len [c];
+        if (l)
+        {
+            if (!bw_write_bits (&w->bs, ULZ_HUFF_LEN_BITS, l))
+                return false;
+            c++;
+            continue;
+        }
+
+        unsigned run = 0;
+        while ((c < 256) && (w->huff->len [c] == 0) &&
+               (run < (1U << ULZ_HUFF_ZRUN_BITS)))
+            c++, run++;
+        if (!bw_write_bits (&w->bs, ULZ_HUFF_LEN_BITS, 0) ||
+            !bw_write_bits (&w->bs, ULZ_HUFF_ZRUN_BITS, run - 1))
+            return false;
+    }
 
     return true;
 }
 
-bool ulz_compress (const void *idata, unsigned isize,
-                   void *odata, unsigned *osize)
+/// Return the code for reference offset
+INLINE_ALWAYS unsigned ulz_ofs_code (const ulz_writer_t *w, unsigned ofs)
 {
+    if (!w->repofs)
+        return ofs - 1;
+    if (ofs == w->rep [0])
+        return ULZ_REP0;
+    if (ofs == w->rep [1])
+        return ULZ_REP1;
+    return ofs - 1 + ULZ_REP_CODES;
+}
 
-    bitstream_t obs;
-    bs_init (&obs, odata, *osize);
+/// Return number of bits used to encode reference offset code
+INLINE_ALWAYS unsigned ulz_ofs_bits (const ulz_writer_t *w, unsigned code)
+{
+    if (!w->large || (code < ULZ24U_0111_LOW))
+        return ulz16u_bits (code);
+    return (code < ULZ24U_1111_LOW) ? ULZ24U_0111_BITS : ULZ24U_1111_BITS;
+}
 
-    // write uncompressed data size to output stream first
-    if (!ulz_write_uleb128 (&obs, isize))
+static bool ulz_ofs_write (ulz_writer_t *w, unsigned code)
+{
+    if (!w->large || (code < ULZ24U_0111_LOW))
+        return ulz16u_write (&w->bs, code);
+    if (code < ULZ24U_1111_LOW)
+        return bw_write_bits (&w->bs, ULZ24U_0111_BITS,
+                              ((code - ULZ24U_0111_LOW) << 4) | ULZ24U_0111_PREFIX);
+    return bw_write_bits (&w->bs, ULZ24U_1111_BITS,
+                          ((code - ULZ24U_1111_LOW) << 4) | ULZ24U_1111_PREFIX);
+}
+
+/// Put a literal followed by a reference into output bitstream
+static bool ulz_write_seq (ulz_writer_t *w, const uint8_t *lit, unsigned lit_len,
+                           unsigned ref_len, unsigned ref_ofs)
+{
+    if (!ulz_write_literal (w, lit, lit_len) ||
+        !ulz16u_write (&w->bs, ref_len - 2) ||
+        !ulz_ofs_write (w, ulz_ofs_code (w, ref_ofs)))
         return false;
 
-    uint8_t *start = (uint8_t *)idata;
-    uint8_t *end = start + isize;
+    if (ref_ofs != w->rep [0])
+    {
+        w->rep [1] = w->rep [0];
+        w->rep [0] = ref_ofs;
+    }
 
-    // Current data pointer
-    uint8_t *cur = start;
-    // Start of literal
-    uint8_t *lit_start = cur;
+    // Decoder outputs the whole reference having read nothing more from
+    // the byte substream, this is where in-place decoding is most likely
+    // to overwrite not yet consumed input
+    int overrun = (lit + lit_len + ref_len - w->idata) - (w->bs.ptr - w->odata);
+    if (overrun > w->overrun)
+        w->overrun = overrun;
 
 #ifdef NOISY
-    unsigned count_dec = 0;
-    unsigned count_enc = (obs.ptr - (uint8_t *)odata) * 8;
+    printf ("REF: [%.*s] <- %u\n", ref_len, lit + lit_len - ref_ofs, ref_ofs);
 #endif
 
-    while (cur < end)
+    return true;
+}
+
+/// How many bits a reference saves compared to same data put into literal
+INLINE_ALWAYS int ulz_ref_gain (const ulz_writer_t *w, unsigned len, unsigned ofs)
+{
+    return len * 8 - ulz16u_bits (len - 2) - ulz_ofs_bits (w, ofs - 1);
+}
+
+/// Same as ulz_ref_gain(), but for the reference written next by writer
+INLINE_ALWAYS int ulz_seq_gain (const ulz_writer_t *w, unsigned len, unsigned ofs)
+{
+    return len * 8 - ulz16u_bits (len - 2) - ulz_ofs_bits (w, ulz_ofs_code (w, ofs));
+}
+
+/**
+ * Check if a reference with one of repeat offsets is better
+ * than the one found by match finder.
+ *
+ * @param w Block writer
+ * @param start Start of input data (including history)
+ * @param cur Current data pointer
+ * @param end End of input data
+ * @param ref_len Length of reference found by match finder, or 0
+ * @param ref_ofs Offset of the reference, updated if a better one found
+ * @return Length of the best reference, or 0
+ */
+static unsigned ulz_rep_find (const ulz_writer_t *w, const uint8_t *start,
+                              const uint8_t *cur, const uint8_t *end,
+                              unsigned ref_len, unsigned *ref_ofs)
+{
+    if (!w->repofs)
+        return ref_len;
+
+    unsigned max_len = MIN ((unsigned)(end - cur), ULZ16U_MAX + 2U);
+    int ref_rating = ref_len ? ulz_seq_gain (w, ref_len, *ref_ofs) : 0;
+    for (unsigned i = 0; i < 2; i++)
     {
-        unsigned ref_ofs = 0;
-        unsigned ref_len = 0;
-
-        // The following code is a pretty dumb attempt to find references
-        // to preceeding data. This certainly can be done much faster,
-        // but this code is very simple and easy to understand.
-
-        // Look back for data at 'cur'
-        uint8_t *low = cur - (ULZ16U_MAX + 1);
-        if (low < start)
-            low = start;
-        uint8_t *high = cur;
-        int ref_rating = 0;
-        while (low < high)
+        unsigned ofs = w->rep [i];
+        if ((ofs == 0) || (ofs > (unsigned)(cur - start)))
+            continue;
+
+        const uint8_t *ptr = cur - ofs;
+        unsigned len = ulz_match_len (ptr, cur, max_len);
+
+        if (len >= 2)
         {
-            uint8_t *ptr = (uint8_t *)memrchr (low, *cur, high - low);
-            if (!ptr)
-                break;
+            int gain = ulz_seq_gain (w, len, ofs);
+            if (gain > ref_rating)
+            {
+                ref_rating = gain;
+                *ref_ofs = ofs;
+                ref_len = len;
+            }
+        }
+    }
+
+    return ref_len;
+}
+
+
+/**
+ * Find the best-rated reference to preceeding data for data at @a cur.
+ * References never go before mf->start.
+ *
+ * @param w Block writer, for offset costs
+ * @param mf Match finder
+ * @param cur Current data pointer
+ * @param end End of input data
+ * @param ref_ofs Receives the reference offset
+ * @return Reference length, or 0 if no profitable reference found
+ */
+static unsigned ulz_mf_find (const ulz_writer_t *w, ulz_mf_t *mf,
+                             const uint8_t *cur, const uint8_t *end,
+                             unsigned *ref_ofs)
+{
+    unsigned ref_len = ulz_mf_short_find (mf, cur, end, ref_ofs);
+    int ref_rating = ref_len ? ulz_ref_gain (w, ref_len, *ref_ofs) : 0;
+    if (ref_rating <= 0)
+        ref_len = ref_rating = 0;
 
-            unsigned len;
-            for (len = 1; (len < (ULZ16U_MAX + 2)) && (ptr [len] == cur [len]); len++)
-                ;
+    if (end - cur < ULZ_MF_MINLEN)
+        return ref_len;
+
+    ulz_mf_update (mf, cur, end);
+
+    unsigned max_len = MIN ((unsigned)(end - cur), ULZ16U_MAX + 2U);
+    unsigned pos = cur - mf->start;
+    unsigned cand = mf->head [ulz_mf_hash (mf, cur)];
+    unsigned depth = ULZ_MF_DEPTH;
+
+    while (cand != 0)
+    {
+        cand--;
+
+        unsigned ofs = pos - cand;
+        if (ofs > mf->ofs_max)
+            break;
+
+        const uint8_t *ptr = mf->start + cand;
+
+        // quick reject if this candidate can't beat the current one
+        if ((ref_len < max_len) && (ptr [ref_len] == cur [ref_len]))
+        {
+            unsigned len = ulz_match_len (ptr, cur, max_len);
 
             if (len >= 2)
             {
-                // Find out how many bits will take the (length-2, offset-1) pair
-                unsigned ofs = cur - ptr;
-                unsigned ofs_bits = ulz16u_bits (ofs - 1);
-                unsigned len_bits = ulz16u_bits (len - 2);
-
-                int gain = len * 8 - len_bits - ofs_bits;
+                int gain = ulz_ref_gain (w, len, ofs);
                 if (gain > ref_rating)
                 {
                     ref_rating = gain;
-                    ref_ofs = cur - ptr;
+                    *ref_ofs = ofs;
                     ref_len = len;
                 }
             }
+        }
+
+        // older positions have been overwritten in the chain ring buffer
+        if ((--depth == 0) || (ofs > mf->chain_mask))
+            break;
+
+        cand = mf->chain [cand & mf->chain_mask];
+    }
+
+    unsigned ofs;
+    unsigned len = ulz_mf_long_find (mf, cur, end, max_len, &ofs);
+    if ((len > ref_len) && (ulz_ref_gain (w, len, ofs) > ref_rating))
+    {
+        *ref_ofs = ofs;
+        ref_len = len;
+    }
+
+    return ref_len;
+}
+
+
+/// "Infinite" path cost for the optimal parser
+#define ULZ_OPT_INF         0x3FFFFFFF
+/// No literal start/reference end, e.g. the literal pending from previous segment
+#define ULZ_OPT_NONE        0xFFFFFFFFU
+
+/**
+ * Optimal parser state for one input position, relative to segment start.
+ * Every path through the data alternates literals and references, so there
+ * are two costs for every position: the cheapest way to arrive here with
+ * a reference (a literal may start here), and the cheapest way to arrive
+ * here with a literal (a reference may start here).
+ */
+typedef struct
+{
+    /// Cost of the best path ending with a reference at this position, bits
+    int32_t ref_price;
+    /// Cost of the best path ending with a literal at this position, bits
+    int32_t lit_price;
+    /// Where the literal ending here starts
+    uint32_t lit_start;
+    /// Length of the reference ending here
+    uint32_t ref_len;
+    /// Offset of the reference ending here
+    uint32_t ref_ofs;
+    /// Second last offset after the reference ending here, for repeat codes
+    uint32_t rep1;
+} ulz_opt_t;
+
+/// Optimal parser context
+typedef struct
+{
+    /// Output block writer
+    ulz_writer_t *w;
+    /// Match finder
+    ulz_mf_t *mf;
+    /// Per-position parser state
+    ulz_opt_t *opt;
+    /// Max segment length (number of entries in opt minus one)
+    unsigned seg_max;
+    /// Start of the pending literal
+    const uint8_t *lit;
+} ulz_opt_ctx_t;
+
+/**
+ * Output the references on the cheapest path ending with a literal
+ * at position @a k of the segment starting at @a seg.
+ * The pending literal is moved to the end of the last reference.
+ */
+static bool ulz_opt_emit (ulz_opt_ctx_t *oc, const uint8_t *seg, unsigned k)
+{
+    ulz_opt_t *opt = oc->opt;
+
+    // Walk the path back, turning it into a forward list of reference ends,
+    // linked through the 'lit_start' field of every reference start
+    uint32_t next = ULZ_OPT_NONE;
+    for (uint32_t i = opt [k].lit_start; i != ULZ_OPT_NONE; )
+    {
+        uint32_t r = i - opt [i].ref_len;
+        uint32_t prev = opt [r].lit_start;
+        opt [r].lit_start = next;
+        next = i;
+        i = prev;
+    }
+
+    while (next != ULZ_OPT_NONE)
+    {
+        uint32_t r = next - opt [next].ref_len;
+        if (!ulz_write_seq (oc->w, oc->lit, (seg + r) - oc->lit,
+                            opt [next].ref_len, opt [next].ref_ofs))
+            return false;
+        oc->lit = seg + next;
+        next = opt [r].lit_start;
+    }
 
-            high = ptr;
+    return true;
+}
+
+/**
+ * Bit-exact optimal parse: find the cheapest sequence of literals and
+ * references for data from @a start to @a end, given the references the
+ * match finder can see.
+ *
+ * The data is parsed in segments of at most oc->seg_max bytes. Within
+ * a segment dynamic programming finds the cheapest path using the exact
+ * ulz16u_bits() costs of lengths and offsets. At the end of the segment
+ * the path is emitted up to the end of its last reference; the rest is
+ * parsed again as part of the next segment. A very long reference is
+ * taken immediately, this keeps time linear on highly redundant data.
+ *
+ * The last literal is left pending in oc->lit.
+ */
+static bool ulz_compress_optimal (ulz_opt_ctx_t *oc, const uint8_t *start,
+                                  const uint8_t *end)
+{
+    ulz_opt_t *opt = oc->opt;
+    const uint8_t *seg = start;
+    ulz_match_t matches [ULZ_MF_MATCHES];
+    // Best (ref_price[j] - 8 * j) over j in [k-275, k-20], a monotonic queue
+    uint32_t mq [ULZ16U_111_LOW - ULZ16U_110_LOW];
+
+    while (seg < end)
+    {
+        unsigned n = MIN ((unsigned)(end - seg), oc->seg_max);
+        // The length of pending literal at segment start
+        unsigned base = seg - oc->lit;
+
+        for (unsigned i = 0; i <= n; i++)
+            opt [i].ref_price = ULZ_OPT_INF;
+        // A literal may start right here if nothing is pending
+        if (base == 0)
+            opt [0].ref_price = 0;
+        // Repeat offsets at segment start, also for the pending literal
+        opt [0].ref_ofs = oc->w->rep [0];
+        opt [0].rep1 = oc->w->rep [1];
+
+        unsigned mq_head = 0, mq_tail = 0;
+        int32_t far_price = ULZ_OPT_INF;
+        unsigned far_start = 0;
+        ulz_match_t *force = NULL;
+        unsigned k;
+
+        for (k = 0; ; k++)
+        {
+            // The cheapest literal ending at k: either the pending one
+            // (all costs are relative to the segment start) ...
+            int32_t best = 8 * k + ulz16u_bits (base + k);
+            uint32_t from = ULZ_OPT_NONE;
+            int32_t c;
+
+#define ULZ_OPT_LIT(j, cost) \
+            if ((c = (cost)) < best) \
+            { \
+                best = c; \
+                from = (j); \
+            }
+
+            // ... or one starting after a reference. Literal length code
+            // takes 3, 6, 11 or 19 bits, so for the two short classes just
+            // try every start, for the two long ones keep the running minimum
+            unsigned j = (k > ULZ16U_110_LOW - 1) ? k - (ULZ16U_110_LOW - 1) : 0;
+            for (; j <= k; j++)
+                if (opt [j].ref_price < ULZ_OPT_INF)
+                    ULZ_OPT_LIT (j, opt [j].ref_price + 8 * (k - j) + ulz16u_bits (k - j));
+
+            if (k >= ULZ16U_110_LOW)
+            {
+                while ((mq_head != mq_tail) &&
+                       (mq [mq_head % ARRAY_LEN (mq)] + (ULZ16U_111_LOW - 1) < k))
+                    mq_head++;
+
+                j = k - ULZ16U_110_LOW;
+                if (opt [j].ref_price < ULZ_OPT_INF)
+                {
+                    int32_t v = opt [j].ref_price - 8 * (int32_t)j;
+                    while ((mq_head != mq_tail) &&
+                           (opt [mq [(mq_tail - 1) % ARRAY_LEN (mq)]].ref_price -
+                            8 * (int32_t)mq [(mq_tail - 1) % ARRAY_LEN (mq)] >= v))
+                        mq_tail--;
+                    mq [mq_tail++ % ARRAY_LEN (mq)] = j;
+                }
+
+                if (mq_head != mq_tail)
+                {
+                    j = mq [mq_head % ARRAY_LEN (mq)];
+                    ULZ_OPT_LIT (j, opt [j].ref_price + 8 * (k - j) + ULZ16U_110_BITS);
+                }
+            }
+
+            if (k >= ULZ16U_111_LOW)
+            {
+                j = k - ULZ16U_111_LOW;
+                if ((opt [j].ref_price < ULZ_OPT_INF) &&
+                    (opt [j].ref_price - 8 * (int32_t)j < far_price))
+                {
+                    far_price = opt [j].ref_price - 8 * (int32_t)j;
+                    far_start = j;
+                }
+                if (far_price < ULZ_OPT_INF)
+                    ULZ_OPT_LIT (far_start, far_price + 8 * k + ULZ16U_111_BITS);
+            }
+
+#undef ULZ_OPT_LIT
+
+            opt [k].lit_price = best;
+            opt [k].lit_start = from;
+
+            if (k >= n)
+                break;
+
+            // Relax all references starting at k
+            unsigned count = ulz_mf_find_all (oc->mf, seg + k, end, ULZ_OPT_NICE, matches);
+            if (count && (matches [count - 1].len >= ULZ_OPT_NICE))
+            {
+                force = &matches [count - 1];
+                break;
+            }
+
+#define ULZ_OPT_REF(len, ofs, cost) \
+            if ((c = (cost)) < opt [k + (len)].ref_price) \
+            { \
+                opt [k + (len)].ref_price = c; \
+                opt [k + (len)].ref_len = (len); \
+                opt [k + (len)].ref_ofs = (ofs); \
+                opt [k + (len)].rep1 = ((ofs) == rep0) ? rep1 : rep0; \
+            }
+
+            // Repeat offsets as the cheapest path to here left them
+            const ulz_opt_t *prev = &opt [(from == ULZ_OPT_NONE) ? 0 : from];
+            unsigned rep0 = prev->ref_ofs, rep1 = prev->rep1;
+
+            unsigned len = 2;
+            for (unsigned m = 0; m < count; m++)
+            {
+                unsigned ofs = matches [m].ofs;
+                unsigned ofs_bits = !oc->w->repofs ? ulz_ofs_bits (oc->w, ofs - 1) :
+                    (ofs == rep0) || (ofs == rep1) ? ULZ16U_0_BITS :
+                    ulz16u_bits (ofs - 1 + ULZ_REP_CODES);
+                unsigned max_len = MIN (matches [m].len, n - k);
+                for (; len <= max_len; len++)
+                    ULZ_OPT_REF (len, ofs, best + ulz16u_bits (len - 2) + ofs_bits);
+            }
+
+            // Match finder doesn't know repeat offsets are cheaper
+            if (oc->w->repofs)
+                for (unsigned i = 0; i < 2; i++)
+                {
+                    unsigned ofs = i ? rep1 : rep0;
+                    if ((ofs == 0) || (ofs > (unsigned)(seg + k - oc->mf->start)))
+                        continue;
+
+                    const uint8_t *cur = seg + k;
+                    const uint8_t *ptr = cur - ofs;
+                    unsigned max_len = MIN (n - k, ULZ_OPT_NICE);
+                    unsigned rlen = ulz_match_len (ptr, cur, max_len);
+                    for (len = 2; len <= rlen; len++)
+                        ULZ_OPT_REF (len, ofs, best + ulz16u_bits (len - 2) + ULZ16U_0_BITS);
+                }
+
+#undef ULZ_OPT_REF
+        }
+
+        const uint8_t *lit = oc->lit;
+        if (!ulz_opt_emit (oc, seg, k))
+            return false;
+
+        if (force)
+        {
+            // Take the long reference, with whatever literal precedes it
+            if (!ulz_write_seq (oc->w, oc->lit, (seg + k) - oc->lit,
+                                force->len, force->ofs))
+                return false;
+            seg = oc->lit = seg + k + force->len;
         }
+        else if ((oc->lit != lit) && (n < (unsigned)(end - seg)))
+            // Parse again everything after the last reference
+            seg = oc->lit;
+        else
+            // No references at all, the literal goes on
+            seg += n;
+    }
+
+    return true;
+}
+
+/**
+ * Greedy and lazy parse: take the best-rated reference at every position,
+ * if it's cheaper than putting same data into literal. The lazy parser
+ * also defers the reference by one byte as long as a better rated
+ * reference starts at next position.
+ */
+static bool ulz_compress_greedy (ulz_writer_t *w, ulz_mf_t *mf,
+                                 const uint8_t *start, const uint8_t *end,
+                                 bool lazy, const uint8_t **lit_start)
+{
+    // Current data pointer
+    const uint8_t *cur = start;
+
+    while (cur < end)
+    {
+        unsigned ref_ofs = 0;
+        unsigned ref_len = ulz_mf_find (w, mf, cur, end, &ref_ofs);
+        ref_len = ulz_rep_find (w, mf->start, cur, end, ref_len, &ref_ofs);
 
         if (ref_len == 0)
             cur++;
         else
         {
-            unsigned lit_len = cur - lit_start;
+            if (lazy)
+            {
+                unsigned next_ofs = 0;
+                unsigned next_len;
+                while ((next_len = ulz_rep_find (w, mf->start, cur + 1, end,
+                            ulz_mf_find (w, mf, cur + 1, end, &next_ofs), &next_ofs)) &&
+                       (ulz_seq_gain (w, next_len, next_ofs) > ulz_seq_gain (w, ref_len, ref_ofs)))
+                {
+                    cur++;
+                    ref_len = next_len;
+                    ref_ofs = next_ofs;
+                }
+            }
+
+            unsigned lit_len = cur - *lit_start;
 
             // Cut our loses if literal gets way too long.
             // If we don't, a long literal trail may stop us from
@@ -174,7 +681,7 @@ bool ulz_compress (const void *idata, unsigned isize,
             {
                 // Check the overall compression rate
                 unsigned enc_len = ulz16u_bits (lit_len) + lit_len * 8 +
-                        ulz16u_bits (ref_len - 2) + ulz16u_bits (ref_ofs - 1);
+                        ulz16u_bits (ref_len - 2) + ulz_ofs_bits (w, ulz_ofs_code (w, ref_ofs));
                 unsigned dec_len = ulz16u_bits (lit_len + ref_len) -
                         (lit_len ? ulz16u_bits (lit_len) : 0) +
                         (lit_len + ref_len) * 8;
@@ -187,37 +694,316 @@ bool ulz_compress (const void *idata, unsigned isize,
                 }
             }
 
-            // Put the literal into output bitstream
-            if (!ulz_write_literal (&obs, lit_start, lit_len))
+            // Put the literal and the reference into output bitstream
+            if (!ulz_write_seq (w, *lit_start, lit_len, ref_len, ref_ofs))
                 // BANG! no space for compressed data
                 return false;
 
-#ifdef NOISY
-            printf ("LIT: [%.*s]\n", lit_len, lit_start);
-            count_enc += ulz16u_bits (lit_len) + lit_len * 8;
-#endif
+            cur += ref_len;
+            *lit_start = cur;
+        }
+    }
 
-            // Put the reference into output stream
-            if (!ulz16u_write (&obs, ref_len - 2) ||
-                !ulz16u_write (&obs, ref_ofs - 1))
-                return false;
+    return true;
+}
 
-#ifdef NOISY
-            printf ("REF: [%.*s] <- %u\n", ref_len, cur - ref_ofs, ref_ofs);
-            count_enc += ulz16u_bits (ref_len - 2) + ulz16u_bits (ref_ofs - 1);
-            count_dec += (cur + ref_len - lit_start) * 8;
-            printf ("GAIN: %d bits of total %u\n", count_dec - count_enc, count_dec);
-#endif
+/// Output callback dropping everything, for parses that only collect statistics
+static bool ulz_drop (void *ctx, const void *data, unsigned size)
+{
+    return true;
+}
 
-            cur += ref_len;
-            lit_start = cur;
+/**
+ * Compress a block, return the writer overrun in *overrun.
+ * In the literal Huffman variant literal statistics is collected
+ * into freq, if not NULL, and literals are coded with huff, if not NULL.
+ * If odata is NULL, output is dropped, so the parse never runs out of room;
+ * *osize and *overrun are meaningless then.
+ */
+static bool ulz_compress_parse (const void *hist, const void *idata, unsigned isize,
+                                  void *odata, unsigned *osize,
+                                  void *workmem, unsigned workmem_size, unsigned level,
+                                  uint32_t *freq, const ulz_huff_t *huff, int *overrun)
+{
+    uint8_t drop [2 * sizeof (br_acc_t)];
+    ulz_writer_t w;
+    ulz_writer_init (&w, odata ? odata : drop, odata ? *osize : sizeof (drop), idata);
+    if (!odata)
+        bw_init_fwd (&w.bs, drop, sizeof (drop), ulz_drop, NULL);
+    w.repofs = (level & (ULZ_FLAG_REPOFS | ULZ_FLAG_HUFF | ULZ_FLAG_LARGE)) == ULZ_FLAG_REPOFS;
+    w.large = (level & ULZ_FLAG_LARGE) != 0;
+    w.freq = freq;
+    w.huff = huff;
+
+    // write uncompressed data size to output stream first
+    if (!ulz_write_uleb128 (&w.bs, isize) ||
+        ((level & ULZ_FLAG_HUFF) && !ulz_write_huff_table (&w)))
+        return false;
+    level &= ~(ULZ_FLAG_REPOFS | ULZ_FLAG_HUFF | ULZ_FLAG_LARGE);
+
+    const uint8_t *start = (const uint8_t *)idata;
+    const uint8_t *end = start + isize;
+    // Start of the pending literal
+    const uint8_t *lit_start = start;
+
+    // Optimal parser takes up to a quarter of working memory,
+    // if there's too little of it, fall back to lazy parsing
+    ulz_opt_ctx_t oc;
+    oc.opt = NULL;
+    oc.seg_max = 0;
+    if (level >= ULZ_LEVEL_OPTIMAL)
+    {
+        unsigned n = MIN (workmem_size / 4 / sizeof (ulz_opt_t), ULZ_OPT_SEG_MAX + 1);
+        if (n > ULZ_OPT_SEG_MIN)
+        {
+            oc.opt = (ulz_opt_t *)workmem;
+            oc.seg_max = n - 1;
+            workmem = oc.opt + n;
+            workmem_size -= n * sizeof (ulz_opt_t);
         }
+        else
+            level = ULZ_LEVEL_LAZY;
     }
 
+    ulz_mf_t mf;
+    if (!ulz_mf_init (&mf, (const uint8_t *)hist, workmem, workmem_size,
+                      w.large ? ULZ_LARGE_OFS_MAX : ULZ_MF_OFS_MAX))
+        return false;
+
+    if (level >= ULZ_LEVEL_OPTIMAL)
+    {
+        // Parsing a segment again needs the chain to cover it
+        oc.seg_max = MIN (oc.seg_max, mf.chain_mask);
+        oc.w = &w;
+        oc.mf = &mf;
+        oc.lit = start;
+        if (!ulz_compress_optimal (&oc, start, end))
+            return false;
+        lit_start = oc.lit;
+    }
+    else if (!ulz_compress_greedy (&w, &mf, start, end,
+                                   level >= ULZ_LEVEL_LAZY, &lit_start))
+        return false;
+
     // Put the last literal into the output stream
-    if (!ulz_write_literal (&obs, lit_start, cur - lit_start))
+    if (!ulz_write_literal (&w, lit_start, end - lit_start))
+        return false;
+
+    *osize = bw_finish (&w.bs);
+    *overrun = w.overrun;
+    return *osize != 0;
+}
+
+/// Size of block with data stored as a single literal
+static unsigned ulz_stored_size (unsigned isize, unsigned level)
+{
+    unsigned bits = ulz16u_bits (isize) + ((level & ULZ_FLAG_HUFF) ? 1 : 0);
+    return uleb128_len (isize) + (bits + 7) / 8 + isize;
+}
+
+/**
+ * Compress a block in the literal Huffman variant: parse it once with
+ * plain literals collecting their statistics, then parse again with
+ * literals coded, if this saves anything. Parsing doesn't depend
+ * on literal coding, so literals are same both times. If plain literals
+ * don't fit into output buffer, the statistics is collected by a parse
+ * which drops its output, as coded literals may still fit.
+ */
+static bool ulz_compress_huff (const void *hist, const void *idata, unsigned isize,
+                               void *odata, unsigned *osize,
+                               void *workmem, unsigned workmem_size, unsigned level,
+                               int *overrun)
+{
+    uint32_t freq [256];
+    memset (freq, 0, sizeof (freq));
+
+    unsigned csize = *osize;
+    bool plain = ulz_compress_parse (hist, idata, isize, odata, &csize,
+                                     workmem, workmem_size, level, freq, NULL, overrun);
+    if (!plain)
+    {
+        unsigned dsize;
+        memset (freq, 0, sizeof (freq));
+        if (!ulz_compress_parse (hist, idata, isize, NULL, &dsize,
+                                 workmem, workmem_size, level, freq, NULL, overrun))
+            return false;
+    }
+
+    unsigned lit_bits = 0;
+    for (unsigned c = 0; c < 256; c++)
+        lit_bits += freq [c] * 8;
+
+    ulz_huff_t huff;
+    unsigned huff_bits = ulz_huff_build (&huff, freq);
+    if ((huff_bits == 0) || (huff_bits + 8 >= lit_bits))
+    {
+        *osize = csize;
+        return plain;
+    }
+
+    unsigned hsize = *osize;
+    if (ulz_compress_parse (hist, idata, isize, odata, &hsize,
+                            workmem, workmem_size, level, NULL, &huff, overrun) &&
+        (!plain || (hsize <= csize)))
+    {
+        *osize = hsize;
+        return true;
+    }
+
+    // Rounding made coded literals a bit larger, go back to plain ones
+    return plain &&
+        ulz_compress_parse (hist, idata, isize, odata, osize,
+                            workmem, workmem_size, level, NULL, NULL, overrun);
+}
+
+/**
+ * Compress a block, falling back to storing data as a single literal
+ * if compressed data does not fit into output buffer or is larger than
+ * stored one. The stored block is never larger than ULZ_COMPRESS_BOUND.
+ */
+static bool ulz_compress_overrun (const void *hist, const void *idata, unsigned isize,
+                                  void *odata, unsigned *osize,
+                                  void *workmem, unsigned workmem_size, unsigned level,
+                                  int *overrun)
+{
+    unsigned csize = *osize;
+    unsigned stored_size = ulz_stored_size (isize, level);
+    if (((level & ULZ_FLAG_HUFF) ?
+         ulz_compress_huff (hist, idata, isize, odata, &csize,
+                            workmem, workmem_size, level, overrun) :
+         ulz_compress_parse (hist, idata, isize, odata, &csize,
+                             workmem, workmem_size, level, NULL, NULL, overrun)) &&
+        (csize <= stored_size))
+    {
+        *osize = csize;
+        return true;
+    }
+
+    if (stored_size > *osize)
+        return false;
+
+    ulz_writer_t w;
+    ulz_writer_init (&w, odata, *osize, idata);
+    if (!ulz_write_uleb128 (&w.bs, isize) ||
+        ((level & ULZ_FLAG_HUFF) && !ulz_write_huff_table (&w)) ||
+        !ulz_write_literal (&w, (const uint8_t *)idata, isize))
         return false;
 
-    *osize = bs_write_finish (&obs, odata, *osize);
+    *osize = bw_finish (&w.bs);
+    // Literal bytes are consumed as fast as they are output
+    *overrun = 0;
     return *osize != 0;
 }
+
+bool ulz_compress_block (const void *hist, const void *idata, unsigned isize,
+                         void *odata, unsigned *osize,
+                         void *workmem, unsigned workmem_size, unsigned level)
+{
+    int overrun;
+    return ulz_compress_overrun (hist, idata, isize, odata, osize,
+                                 workmem, workmem_size, level, &overrun);
+}
+
+/// The variant header byte for compression level, 0 for the plain format
+static unsigned ulz_variant (unsigned level)
+{
+    if (level & ULZ_FLAG_LARGE)
+        return ULZ_FRAME_FLAG_LARGE | ((level & ULZ_FLAG_HUFF) ? ULZ_FRAME_FLAG_HUFF : 0);
+    if (level & ULZ_FLAG_HUFF)
+        return ULZ_FRAME_FLAG_HUFF;
+    if (level & ULZ_FLAG_REPOFS)
+        return ULZ_FRAME_FLAG_REPOFS;
+    return 0;
+}
+
+bool ulz_compress_wm (const void *idata, unsigned isize,
+                      void *odata, unsigned *osize,
+                      void *workmem, unsigned workmem_size, unsigned level)
+{
+    unsigned variant = ulz_variant (level);
+    if (variant == 0)
+        return ulz_compress_block (idata, idata, isize, odata, osize,
+                                   workmem, workmem_size, level);
+
+    // Prefix the block with a header that plain decoders choke on
+    if (*osize < ULZ_VARIANT_HDR_SIZE)
+        return false;
+
+    uint8_t *out = put_uleb128 ((uint8_t *)odata, ULZ_VARIANT_MARK);
+    *out++ = variant;
+    unsigned csize = *osize - ULZ_VARIANT_HDR_SIZE;
+    if (!ulz_compress_block (idata, idata, isize, out, &csize,
+                             workmem, workmem_size, level))
+        return false;
+
+    *osize = csize + ULZ_VARIANT_HDR_SIZE;
+    return true;
+}
+
+bool ulz_compress (const void *idata, unsigned isize,
+                   void *odata, unsigned *osize, unsigned level)
+{
+    uint32_t workmem [ULZ_WORKMEM_SIZE / sizeof (uint32_t)];
+    return ulz_compress_wm (idata, isize, odata, osize,
+                            workmem, sizeof (workmem), level);
+}
+
+bool ulz_compress_dict (const void *dict, unsigned dict_size,
+                        const void *idata, unsigned isize,
+                        void *odata, unsigned *osize,
+                        void *workmem, unsigned workmem_size, unsigned level)
+{
+    if (dict_size > ULZ_DICT_MAX)
+    {
+        dict = (const uint8_t *)dict + dict_size - ULZ_DICT_MAX;
+        dict_size = ULZ_DICT_MAX;
+    }
+
+    // Put dictionary and data together, keeping match finder memory aligned
+    unsigned size = (dict_size + isize + 3) & ~3U;
+    if ((size < isize) || (workmem_size < size))
+        return false;
+
+    uint8_t *buff = (uint8_t *)workmem;
+    memcpy (buff, dict, dict_size);
+    memcpy (buff + dict_size, idata, isize);
+
+    return ulz_compress_block (buff, buff + dict_size, isize, odata, osize,
+                               buff + size, workmem_size - size,
+                               level & ~(ULZ_FLAG_REPOFS | ULZ_FLAG_HUFF | ULZ_FLAG_LARGE));
+}
+
+bool ulz_compress_inplace (const void *idata, unsigned isize,
+                           void *odata, unsigned *osize,
+                           void *workmem, unsigned workmem_size, unsigned level)
+{
+    // Compress leaving space for the largest margin, move down later
+    if (*osize < ULZ_INPLACE_HDR_MAX)
+        return false;
+
+    unsigned csize = *osize - ULZ_INPLACE_HDR_MAX;
+    int overrun;
+    if (!ulz_compress_overrun (idata, idata, isize,
+                               (uint8_t *)odata + ULZ_INPLACE_HDR_MAX, &csize,
+                               workmem, workmem_size,
+                               level & ~(ULZ_FLAG_REPOFS | ULZ_FLAG_HUFF | ULZ_FLAG_LARGE),
+                               &overrun))
+        return false;
+
+    // The block is placed at (isize + margin - csize) in the buffer,
+    // it must not go below the end of reference having consumed everything
+    // before; also the whole image must fit into the buffer
+    unsigned margin = MAX (overrun + (int)csize - (int)isize, 0);
+    while (isize + margin < csize + uleb128_len (margin))
+        margin = csize + uleb128_len (margin) - isize;
+
+    bitwriter_t bs;
+    bw_init (&bs, odata, ULZ_INPLACE_HDR_MAX);
+    ulz_write_uleb128 (&bs, margin);
+    unsigned hdr_size = bs.ptr - (uint8_t *)odata;
+
+    memmove (bs.ptr, (uint8_t *)odata + ULZ_INPLACE_HDR_MAX, csize);
+
+    *osize = hdr_size + csize;
+    return true;
+}
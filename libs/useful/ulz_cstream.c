@@ -0,0 +1,137 @@
+/*
+    uLZ streaming compressor
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+#include "ulz_priv.h"
+
+static bool ulz_cstream_uleb128 (ulz_cstream_t *cs, unsigned value)
+{
+    uint8_t chips [LEB128_MAX_32];
+    return cs->write (cs->ctx, chips, put_uleb128 (chips, value) - chips);
+}
+
+bool ulz_cstream_init (ulz_cstream_t *cs, unsigned win_log, unsigned blk_log,
+                       void *mem, unsigned mem_size,
+                       ulz_write_t write, void *ctx)
+{
+    if ((win_log > ULZ_FRAME_WIN_LOG_LARGE_MAX) ||
+        (blk_log < ULZ_FRAME_BLK_LOG_MIN) ||
+        (blk_log > ULZ_FRAME_BLK_LOG_MAX) ||
+        (win_log > blk_log + ULZ_CSTREAM_WIN_BLK_LOG))
+        return false;
+
+    unsigned win_size = win_log ? (1U << win_log) : 0;
+    unsigned blk_size = 1U << blk_log;
+    unsigned buff_size = win_size + 2 * blk_size;
+    if ((mem_size < buff_size) ||
+        (((mem_size - buff_size) & ~3) < ULZ_CSTREAM_WORKMEM_MIN))
+        return false;
+
+    // Match finder memory goes first as it needs alignment
+    cs->workmem = mem;
+    cs->workmem_size = (mem_size - buff_size) & ~3;
+    cs->buff = (uint8_t *)mem + cs->workmem_size;
+    cs->obuf = cs->buff + win_size + blk_size;
+    cs->win_size = win_size;
+    cs->blk_size = blk_size;
+    cs->hist = 0;
+    cs->fill = 0;
+    cs->level = ULZ_LEVEL_GREEDY;
+    cs->blk_log = blk_log;
+    cs->win_log = win_log;
+    cs->started = false;
+    cs->write = write;
+    cs->ctx = ctx;
+    return true;
+}
+
+/// Output frame header, if not yet
+static bool ulz_cstream_header (ulz_cstream_t *cs)
+{
+    if (cs->started)
+        return true;
+
+    // Block format can't change after this
+    cs->started = true;
+    cs->huff = (cs->level & ULZ_FLAG_HUFF) != 0;
+    cs->large = (cs->level & ULZ_FLAG_LARGE) || (cs->win_log > ULZ_FRAME_WIN_LOG_MAX);
+
+    uint8_t hdr [ULZ_FRAME_HDR_SIZE] =
+    {
+        ULZ_FRAME_MAGIC0, ULZ_FRAME_MAGIC1, ULZ_FRAME_MAGIC2, ULZ_FRAME_MAGIC3,
+        (cs->huff ? ULZ_FRAME_FLAG_HUFF : 0) | (cs->large ? ULZ_FRAME_FLAG_LARGE : 0) |
+        ((cs->level & ULZ_FLAG_THUMB) ? ULZ_FRAME_FLAG_THUMB : 0),
+        cs->blk_log, cs->win_log
+    };
+
+    return cs->write (cs->ctx, hdr, sizeof (hdr));
+}
+
+static bool ulz_cstream_block (ulz_cstream_t *cs)
+{
+    uint8_t *data = cs->buff + cs->hist;
+    unsigned size = cs->fill - cs->hist;
+    if (size == 0)
+        return true;
+
+    if (!ulz_cstream_header (cs))
+        return false;
+
+    // If block doesn't compress, store it as is
+    unsigned osize = cs->blk_size;
+    unsigned level = (cs->level & ~(ULZ_FLAG_REPOFS | ULZ_FLAG_HUFF | ULZ_FLAG_LARGE |
+                                    ULZ_FLAG_THUMB)) |
+        (cs->huff ? ULZ_FLAG_HUFF : 0) | (cs->large ? ULZ_FLAG_LARGE : 0);
+    bool ok;
+    if (ulz_compress_block (cs->buff, data, size, cs->obuf, &osize,
+                            cs->workmem, cs->workmem_size, level) &&
+        (osize < size))
+        ok = ulz_cstream_uleb128 (cs, osize << 1) &&
+             cs->write (cs->ctx, cs->obuf, osize);
+    else
+        ok = ulz_cstream_uleb128 (cs, (size << 1) | 1) &&
+             cs->write (cs->ctx, data, size);
+
+    // Keep at most win_size bytes of history
+    unsigned keep = MIN (cs->fill, cs->win_size);
+    memmove (cs->buff, cs->buff + cs->fill - keep, keep);
+
+    cs->hist = cs->fill = keep;
+    return ok;
+}
+
+bool ulz_cstream_feed (ulz_cstream_t *cs, const void *data, unsigned size)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    while (size)
+    {
+        unsigned n = MIN (size, cs->blk_size - (cs->fill - cs->hist));
+        memcpy (cs->buff + cs->fill, src, n);
+        cs->fill += n;
+        src += n;
+        size -= n;
+
+        if ((cs->fill - cs->hist == cs->blk_size) && !ulz_cstream_block (cs))
+            return false;
+    }
+
+    return true;
+}
+
+bool ulz_cstream_flush (ulz_cstream_t *cs)
+{
+    return ulz_cstream_block (cs);
+}
+
+bool ulz_cstream_finish (ulz_cstream_t *cs)
+{
+    return ulz_cstream_block (cs) &&
+           ulz_cstream_header (cs) &&
+           ulz_cstream_uleb128 (cs, 0);
+}
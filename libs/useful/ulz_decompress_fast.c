@@ -0,0 +1,197 @@
+/*
+    uLZ compression library
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+#include "useful/bitstream.h"
+#include "ulz_priv.h"
+
+/* This is a speed-optimized version of ulz_decompress(). It is larger,
+ * but decodes the same streams into exactly the same data:
+ *
+ * - the bit substream is read through a register-wide reservoir
+ *   (see bitreader_t), refilled with one word load;
+ * - an ulz16u code is decoded with one lookup by its three lowest bits;
+ * - references are copied by words if offset is >= 4, and shorter offsets
+ *   are first widened to a multiple of the period that is >= 4.
+ *
+ * Same code, specialized at compile time, decodes the repeat offset
+ * variant of the format for ulz_decompress_rep().
+ */
+
+/// Unaligned 32-bit word; the compiler knows best how to access it
+typedef struct { uint32_t v; } PACKED ulz_u32_t;
+
+#define LOAD32(p)       (((const ulz_u32_t *)(p))->v)
+#define STORE32(p,x)    (((ulz_u32_t *)(p))->v = (x))
+
+/// ulz16u code classes, indexed by three lowest bits of the code
+static const struct
+{
+    uint8_t bits;
+    uint8_t shift;
+    uint16_t low;
+} ulz16u_class [8] =
+{
+    { ULZ16U_0_BITS,   1, ULZ16U_0_LOW   },     // xx0
+    { ULZ16U_10_BITS,  2, ULZ16U_10_LOW  },     // x01
+    { ULZ16U_0_BITS,   1, ULZ16U_0_LOW   },     // xx0
+    { ULZ16U_110_BITS, 3, ULZ16U_110_LOW },     // 011
+    { ULZ16U_0_BITS,   1, ULZ16U_0_LOW   },     // xx0
+    { ULZ16U_10_BITS,  2, ULZ16U_10_LOW  },     // x01
+    { ULZ16U_0_BITS,   1, ULZ16U_0_LOW   },     // xx0
+    { ULZ16U_111_BITS, 3, ULZ16U_111_LOW },     // 111
+};
+
+INLINE_ALWAYS bool ulz_br_read (bitreader_t *br, uint32_t *value)
+{
+    if (br->acc_bits < ULZ16U_111_BITS)
+        br_refill (br);
+
+    unsigned cls = br->acc & 7;
+    unsigned bits = ulz16u_class [cls].bits;
+    if (bits > br->acc_bits)
+        return false;
+
+    uint32_t v = br->acc & ((1U << bits) - 1);
+    br->acc >>= bits;
+    br->acc_bits -= bits;
+    *value = (v >> ulz16u_class [cls].shift) + ulz16u_class [cls].low;
+
+    // if value is larger than ULZ16U_MAX, it is encoded in 32 raw bits
+    if (*value == ULZ16U_RAW32)
+    {
+        if (br_avail (br) < sizeof (uint32_t))
+            return false;
+        *value = UINT32_LE (LOAD32 (br->ptr));
+        br_skip_bytes (br, sizeof (uint32_t));
+    }
+
+    return true;
+}
+
+/// The decoder for both format variants, specialized by constant @a repofs
+INLINE_ALWAYS bool ulz_decompress_fast_var (const void *idata, unsigned isize,
+                                            void *odata, unsigned *osize,
+                                            bool repofs)
+{
+    bitreader_t br;
+    br_init (&br, idata, isize);
+
+    unsigned dec_size = ulz_read_uleb128 (&br.ptr, isize);
+    if (dec_size > *osize)
+        // either broken compressed stream, or not enough big buffer
+        return false;
+
+    uint8_t *start = (uint8_t *)odata;
+    uint8_t *cur = start;
+    uint8_t *end = cur + dec_size;
+    *osize = dec_size;
+    // Last two reference offsets, for the repeat offset variant
+    uint32_t rep0 = 0, rep1 = 0;
+
+    while (cur < end)
+    {
+        uint32_t lit_len;
+        if (!ulz_br_read (&br, &lit_len) ||
+            (lit_len > (unsigned)(end - cur)) ||
+            (lit_len > br_avail (&br)))
+            return false;
+
+        memcpy (cur, br.ptr, lit_len);
+        br_skip_bytes (&br, lit_len);
+        cur += lit_len;
+        if (cur >= end)
+            break;
+
+        uint32_t ref_len, ref_ofs;
+        if (!ulz_br_read (&br, &ref_len) ||
+            ((ref_len += 2) > (unsigned)(end - cur)) ||
+            !ulz_br_read (&br, &ref_ofs))
+            return false;
+
+        if (!repofs)
+            ref_ofs++;
+        else
+        {
+            // Written to compile into conditional moves, as repeat
+            // and new offsets come in quite unpredictable order
+            uint32_t ofs = ref_ofs - (ULZ_REP_CODES - 1);
+            ofs = (ref_ofs == ULZ_REP1) ? rep1 : ofs;
+            ofs = (ref_ofs == ULZ_REP0) ? rep0 : ofs;
+            rep1 = (ref_ofs == ULZ_REP0) ? rep1 : rep0;
+            rep0 = ref_ofs = ofs;
+        }
+
+        if ((ref_ofs == 0) || (ref_ofs > (unsigned)(cur - start)))
+            return false;
+
+        const uint8_t *ref = cur - ref_ofs;
+        if (ref_ofs == 1)
+        {
+            // a run of same bytes: fill with a replicated byte
+            uint32_t pattern = *ref * 0x01010101U;
+            while (ref_len >= 4)
+            {
+                STORE32 (cur, pattern);
+                cur += 4;
+                ref_len -= 4;
+            }
+        }
+        else
+        {
+            if (ref_ofs < 4)
+            {
+                // Data is periodic with period ref_ofs, so copying from
+                // (ref_ofs * 2) bytes back is the same; do a few bytes
+                // one by one until we get a period of at least 4 bytes
+                unsigned n = (ref_ofs == 2) ? 2 : 3;
+                if (n > ref_len)
+                    n = ref_len;
+                ref_len -= n;
+                while (n--)
+                    *cur++ = *ref++;
+                ref = cur - ((ref_ofs == 2) ? 4 : 6);
+            }
+
+            while (ref_len >= 4)
+            {
+                STORE32 (cur, LOAD32 (ref));
+                cur += 4;
+                ref += 4;
+                ref_len -= 4;
+            }
+        }
+
+        // Copy the rest byte by byte
+        ref = cur - ref_ofs;
+        while (ref_len--)
+            *cur++ = *ref++;
+    }
+
+    return true;
+}
+
+bool ulz_decompress_fast (const void *idata, unsigned isize,
+                          void *odata, unsigned *osize)
+{
+    return ulz_decompress_fast_var (idata, isize, odata, osize, false);
+}
+
+bool ulz_decompress_rep_block (const void *idata, unsigned isize,
+                               void *odata, unsigned *osize)
+{
+    return ulz_decompress_fast_var (idata, isize, odata, osize, true);
+}
+
+bool ulz_decompress_rep (const void *idata, unsigned isize,
+                         void *odata, unsigned *osize)
+{
+    return ulz_skip_variant (&idata, &isize, ULZ_FRAME_FLAG_REPOFS) &&
+           ulz_decompress_rep_block (idata, isize, odata, osize);
+}
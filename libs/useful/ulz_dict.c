@@ -0,0 +1,39 @@
+/*
+    uLZ decompression with preset dictionary
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+#include "ulz_priv.h"
+
+bool ulz_decompress_dict (const void *dict, unsigned dict_size,
+                          const void *idata, unsigned isize,
+                          void *odata, unsigned *osize)
+{
+    if (dict_size > ULZ_DICT_MAX)
+    {
+        dict = (const uint8_t *)dict + dict_size - ULZ_DICT_MAX;
+        dict_size = ULZ_DICT_MAX;
+    }
+
+    if (*osize < dict_size)
+        return false;
+
+    // Dictionary goes right before decompressed data, as history
+    uint8_t *out = (uint8_t *)odata;
+    memcpy (out, dict, dict_size);
+
+    unsigned size = *osize - dict_size;
+    if (!ulz_decompress_block (idata, isize, out, out + dict_size, &size))
+        return false;
+
+    // Move data down, overwriting the dictionary
+    memmove (out, out + dict_size, size);
+
+    *osize = size;
+    return true;
+}
@@ -0,0 +1,183 @@
+/*
+    uLZ streaming decompressor
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+#include "ulz_priv.h"
+
+void ulz_dstream_init (ulz_dstream_t *ds, void *mem, unsigned mem_size,
+                       ulz_write_t write, void *ctx)
+{
+    ds->write = write;
+    ds->ctx = ctx;
+    ds->mem = (uint8_t *)mem;
+    ds->mem_size = mem_size;
+    ds->hist = 0;
+    ds->need = ULZ_FRAME_HDR_SIZE;
+    ds->have = 0;
+    ds->state = ULZ_DS_HEADER;
+}
+
+static bool ulz_dstream_header (ulz_dstream_t *ds)
+{
+    const uint8_t *hdr = ds->mem;
+    unsigned blk_log = hdr [5];
+    unsigned win_log = hdr [6];
+
+    if ((hdr [0] != ULZ_FRAME_MAGIC0) || (hdr [1] != ULZ_FRAME_MAGIC1) ||
+        (hdr [2] != ULZ_FRAME_MAGIC2) || (hdr [3] != ULZ_FRAME_MAGIC3) ||
+        (hdr [4] & ~(ULZ_FRAME_FLAG_THUMB | ULZ_FRAME_FLAG_HUFF | ULZ_FRAME_FLAG_LARGE)) ||
+        (win_log > ((hdr [4] & ULZ_FRAME_FLAG_LARGE) ?
+                    ULZ_FRAME_WIN_LOG_LARGE_MAX : ULZ_FRAME_WIN_LOG_MAX)) ||
+        (blk_log < ULZ_FRAME_BLK_LOG_MIN) ||
+        (blk_log > ULZ_FRAME_BLK_LOG_MAX) ||
+        (ds->mem_size < ULZ_DSTREAM_MEM (win_log, blk_log)))
+        return false;
+
+    ds->win_size = win_log ? (1U << win_log) : 0;
+    ds->blk_size = 1U << blk_log;
+    ds->ibuf = ds->mem + ds->win_size + ds->blk_size;
+
+    ds->huff = (hdr [4] & ULZ_FRAME_FLAG_HUFF) != 0;
+    ds->large = (hdr [4] & ULZ_FRAME_FLAG_LARGE) != 0;
+
+    // Decoded data goes through the filter on its way to output
+    ds->thumb = (hdr [4] & ULZ_FRAME_FLAG_THUMB) != 0;
+    if (ds->thumb)
+    {
+        ulz_thumb_init (&ds->tf, false, ds->write, ds->ctx);
+        ds->write = ulz_thumb_write;
+        ds->ctx = &ds->tf;
+    }
+    return true;
+}
+
+static bool ulz_dstream_block (ulz_dstream_t *ds)
+{
+    uint8_t *out = ds->mem + ds->hist;
+    unsigned size = ds->need;
+
+    if (!ds->stored)
+    {
+        size = ds->blk_size;
+        if (!(ds->large ?
+              ulz_decompress_large_block (ds->ibuf, ds->need, ds->mem, out, &size, ds->huff) :
+              ds->huff ?
+              ulz_decompress_huff_block (ds->ibuf, ds->need, ds->mem, out, &size) :
+              ulz_decompress_block (ds->ibuf, ds->need, ds->mem, out, &size)))
+            return false;
+    }
+
+    if (!ds->write (ds->ctx, out, size))
+        return false;
+
+    // Keep at most win_size bytes of history
+    unsigned fill = ds->hist + size;
+    unsigned keep = MIN (fill, ds->win_size);
+    memmove (ds->mem, ds->mem + fill - keep, keep);
+
+    ds->hist = keep;
+    return true;
+}
+
+bool ulz_dstream_feed (ulz_dstream_t *ds, const void *data, unsigned size)
+{
+    const uint8_t *src = (const uint8_t *)data;
+
+    while (size)
+        switch (ds->state)
+        {
+            case ULZ_DS_HEADER:
+            {
+                if (ds->mem_size < ULZ_FRAME_HDR_SIZE)
+                    goto error;
+
+                unsigned n = MIN (size, ds->need - ds->have);
+                memcpy (ds->mem + ds->have, src, n);
+                ds->have += n;
+                src += n;
+                size -= n;
+
+                if (ds->have < ds->need)
+                    break;
+
+                if (!ulz_dstream_header (ds))
+                    goto error;
+
+                ds->need = 0;
+                ds->shift = 0;
+                ds->state = ULZ_DS_BLKHDR;
+                break;
+            }
+
+            case ULZ_DS_BLKHDR:
+            {
+                // block header is an uleb128, collect it in ds->need
+                uint8_t chip = *src++;
+                size--;
+
+                // the fifth chip has only 4 bits that fit into 32 bits
+                if ((ds->shift > 7 * 4) ||
+                    ((ds->shift == 7 * 4) && ((chip & 0x7F) > 0x0F)))
+                    goto error;
+                ds->need |= (unsigned)(chip & 0x7F) << ds->shift;
+                ds->shift += 7;
+                if (chip & 0x80)
+                    break;
+
+                if (ds->need == 0)
+                {
+                    if (ds->thumb && !ulz_thumb_finish (&ds->tf))
+                        goto error;
+                    ds->state = ULZ_DS_DONE;
+                    break;
+                }
+
+                ds->stored = ds->need & 1;
+                ds->need >>= 1;
+                if ((ds->need == 0) || (ds->need > ds->blk_size))
+                    goto error;
+
+                ds->have = 0;
+                ds->state = ULZ_DS_BLOCK;
+                break;
+            }
+
+            case ULZ_DS_BLOCK:
+            {
+                // stored blocks go right to their place in window
+                uint8_t *dst = ds->stored ? ds->mem + ds->hist : ds->ibuf;
+                unsigned n = MIN (size, ds->need - ds->have);
+                memcpy (dst + ds->have, src, n);
+                ds->have += n;
+                src += n;
+                size -= n;
+
+                if (ds->have < ds->need)
+                    break;
+
+                if (!ulz_dstream_block (ds))
+                    goto error;
+
+                ds->need = 0;
+                ds->shift = 0;
+                ds->state = ULZ_DS_BLKHDR;
+                break;
+            }
+
+            default:
+                // either an error, or junk after end of frame
+                goto error;
+        }
+
+    return true;
+
+error:
+    ds->state = ULZ_DS_ERROR;
+    return false;
+}
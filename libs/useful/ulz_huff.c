@@ -0,0 +1,407 @@
+/*
+    uLZ literal Huffman coding and large window decoder
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+#include "useful/bitstream.h"
+#include "ulz_priv.h"
+
+/**
+ * Compute Huffman code lengths in place (Moffat & Katajainen).
+ * On input w contains n > 1 weights in increasing order, on output
+ * it contains code lengths, in decreasing order.
+ */
+static void ulz_huff_lengths (uint32_t *w, unsigned n)
+{
+    unsigned root, leaf, next;
+
+    // Combine weights, leaving parent pointers in place of internal nodes
+    w [0] += w [1];
+    root = 0;
+    leaf = 2;
+    for (next = 1; next < n - 1; next++)
+    {
+        if ((leaf >= n) || (w [root] < w [leaf]))
+        {
+            w [next] = w [root];
+            w [root++] = next;
+        }
+        else
+            w [next] = w [leaf++];
+
+        if ((leaf >= n) || ((root < next) && (w [root] < w [leaf])))
+        {
+            w [next] += w [root];
+            w [root++] = next;
+        }
+        else
+            w [next] += w [leaf++];
+    }
+
+    // Depths of internal nodes
+    w [n - 2] = 0;
+    for (next = n - 2; next-- > 0; )
+        w [next] = w [w [next]] + 1;
+
+    // Depths of leaves
+    unsigned avail = 1, used = 0, depth = 0;
+    int inode = n - 2;
+    next = n;
+    while (avail)
+    {
+        while ((inode >= 0) && (w [inode] == depth))
+        {
+            used++;
+            inode--;
+        }
+        while (avail > used)
+        {
+            w [--next] = depth;
+            avail--;
+        }
+        avail = 2 * used;
+        depth++;
+        used = 0;
+    }
+}
+
+unsigned ulz_huff_build (ulz_huff_t *huff, const uint32_t *freq)
+{
+    // Used byte values sorted by frequency
+    uint8_t sym [256];
+    uint32_t w [256];
+    unsigned n = 0;
+    unsigned shift = 0;
+
+    memset (huff->len, 0, sizeof (huff->len));
+
+    for (;;)
+    {
+        n = 0;
+        for (unsigned c = 0; c < 256; c++)
+            if (freq [c])
+            {
+                // Scale frequencies down until code fits into length limit
+                uint32_t f = (freq [c] >> shift) | 1;
+                unsigned i = n++;
+                for (; (i > 0) && (w [i - 1] > f); i--)
+                {
+                    w [i] = w [i - 1];
+                    sym [i] = sym [i - 1];
+                }
+                w [i] = f;
+                sym [i] = c;
+            }
+
+        if (n == 0)
+            return 0;
+        if (n == 1)
+        {
+            w [0] = 1;
+            break;
+        }
+
+        ulz_huff_lengths (w, n);
+        if (w [0] <= ULZ_HUFF_MAXLEN)
+            break;
+        shift++;
+    }
+
+    for (unsigned i = 0; i < n; i++)
+        huff->len [sym [i]] = w [i];
+
+    // Assign canonical codes and count the cost
+    unsigned count [ULZ_HUFF_MAXLEN + 1];
+    unsigned next [ULZ_HUFF_MAXLEN + 1];
+    memset (count, 0, sizeof (count));
+    for (unsigned c = 0; c < 256; c++)
+        count [huff->len [c]]++;
+
+    unsigned code = 0;
+    count [0] = 0;
+    for (unsigned l = 1; l <= ULZ_HUFF_MAXLEN; l++)
+    {
+        code = (code + count [l - 1]) << 1;
+        next [l] = code;
+    }
+
+    unsigned bits = 1;
+    for (unsigned c = 0; c < 256; )
+    {
+        unsigned l = huff->len [c];
+        if (l == 0)
+        {
+            // a run of unused byte values
+            unsigned run = 0;
+            while ((c < 256) && (huff->len [c] == 0) &&
+                   (run < (1U << ULZ_HUFF_ZRUN_BITS)))
+                c++, run++;
+            bits += ULZ_HUFF_LEN_BITS + ULZ_HUFF_ZRUN_BITS;
+            continue;
+        }
+
+        unsigned v = next [l]++, r = 0;
+        for (unsigned i = 0; i < l; i++, v >>= 1)
+            r = (r << 1) | (v & 1);
+        huff->code [c] = r;
+        bits += ULZ_HUFF_LEN_BITS + freq [c] * l;
+        c++;
+    }
+
+    return bits;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Codes up to this length are decoded with a single table lookup
+#define ULZ_HUFF_FAST_BITS  8
+
+/// Canonical Huffman decoder table
+typedef struct
+{
+    /// Number of codes of every length
+    uint16_t count [ULZ_HUFF_MAXLEN + 1];
+    /// Byte values in code order
+    uint8_t symbol [256];
+    /// Code length << 8 | byte value, indexed by next ULZ_HUFF_FAST_BITS bits;
+    /// 0 if code is longer
+    uint16_t fast [1 << ULZ_HUFF_FAST_BITS];
+} ulz_huff_dec_t;
+
+static bool ulz_huff_read_table (bitreader_t *br, ulz_huff_dec_t *hd)
+{
+    uint8_t len [256];
+    for (unsigned c = 0; c < 256; )
+    {
+        unsigned l = br_read_bits (br, ULZ_HUFF_LEN_BITS);
+        if (l == 0)
+        {
+            unsigned run = br_read_bits (br, ULZ_HUFF_ZRUN_BITS) + 1;
+            if (run > 256 - c)
+                return false;
+            while (run--)
+                len [c++] = 0;
+        }
+        else if (l > ULZ_HUFF_MAXLEN)
+            return false;
+        else
+            len [c++] = l;
+    }
+
+    if (br->exhausted)
+        return false;
+
+    memset (hd->count, 0, sizeof (hd->count));
+    for (unsigned c = 0; c < 256; c++)
+        hd->count [len [c]]++;
+    hd->count [0] = 0;
+
+    // Reject over-subscribed codes, incomplete ones are fine
+    int left = 1;
+    uint16_t offs [ULZ_HUFF_MAXLEN + 1];
+    offs [1] = 0;
+    for (unsigned l = 1; l <= ULZ_HUFF_MAXLEN; l++)
+    {
+        left = (left << 1) - hd->count [l];
+        if (left < 0)
+            return false;
+        if (l < ULZ_HUFF_MAXLEN)
+            offs [l + 1] = offs [l] + hd->count [l];
+    }
+
+    for (unsigned c = 0; c < 256; c++)
+        if (len [c])
+            hd->symbol [offs [len [c]]++] = c;
+
+    // Code bits come from the most significant one, so
+    // lookup index is the code reversed, followed by any bits
+    memset (hd->fast, 0, sizeof (hd->fast));
+    unsigned code = 0, index = 0;
+    for (unsigned l = 1; l <= ULZ_HUFF_FAST_BITS; l++)
+    {
+        for (unsigned i = 0; i < hd->count [l]; i++, code++, index++)
+        {
+            unsigned rev = 0;
+            for (unsigned b = 0; b < l; b++)
+                rev |= ((code >> b) & 1) << (l - 1 - b);
+            for (unsigned j = rev; j < ARRAY_LEN (hd->fast); j += 1 << l)
+                hd->fast [j] = (l << 8) | hd->symbol [index];
+        }
+        code <<= 1;
+    }
+
+    return true;
+}
+
+/// Decode a literal byte, return -1 on invalid code
+static int ulz_huff_decode (bitreader_t *br, const ulz_huff_dec_t *hd)
+{
+    unsigned bits = br_peek_bits (br, ULZ_HUFF_MAXLEN);
+    unsigned e = hd->fast [bits & (ARRAY_LEN (hd->fast) - 1)];
+    if (e)
+    {
+        br_skip_bits (br, e >> 8);
+        return e & 0xFF;
+    }
+
+    // Longer codes are walked bit by bit
+    int code = 0, first = 0, index = 0;
+    for (unsigned l = 1; l <= ULZ_HUFF_MAXLEN; l++)
+    {
+        code |= bits & 1;
+        bits >>= 1;
+        int count = hd->count [l];
+        if (code - count < first)
+        {
+            br_skip_bits (br, l);
+            return hd->symbol [index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Same as in c/ulz_decompress.c, which is replaced by assembly on some CPUs,
+ * but reads ulz24u instead if @a large is true.
+ */
+static bool ulz16u_read (bitreader_t *br, uint32_t *value, bool large)
+{
+    unsigned v = br_read_bits (br, ULZ16U_0_BITS);
+    if (br->exhausted)
+        return false;
+
+    if (!(v & 1))
+        *value = (v >> 1) + ULZ16U_0_LOW;
+    else if (!(v & 2))
+    {
+        v |= br_read_bits (br, ULZ16U_10_BITS - ULZ16U_0_BITS) << ULZ16U_0_BITS;
+        *value = (v >> 2) + ULZ16U_10_LOW;
+    }
+    else if (!(v & 4))
+    {
+        v |= br_read_bits (br, ULZ16U_110_BITS - ULZ16U_0_BITS) << ULZ16U_0_BITS;
+        *value = (v >> 3) + ULZ16U_110_LOW;
+    }
+    else if (large)
+    {
+        if (!br_read_bits (br, 1))
+            *value = br_read_bits (br, ULZ24U_0111_BITS - 4) + ULZ24U_0111_LOW;
+        else
+            *value = br_read_bits (br, ULZ24U_1111_BITS - 4) + ULZ24U_1111_LOW;
+    }
+    else
+    {
+        v |= br_read_bits (br, ULZ16U_111_BITS - ULZ16U_0_BITS) << ULZ16U_0_BITS;
+        *value = (v >> 3) + ULZ16U_111_LOW;
+
+        if (*value == ULZ16U_RAW32)
+            return br_read_bytes (br, value, sizeof (uint32_t));
+    }
+
+    return !br->exhausted;
+}
+
+/**
+ * Decompress a block in the literal Huffman variant (if @a huff is true),
+ * in the large window variant (if @a large is true), or in both.
+ */
+static bool ulz_decompress_var (const void *idata, unsigned isize,
+                                const void *hist, void *odata, unsigned *osize,
+                                bool huff, bool large)
+{
+    bitreader_t ibs;
+    br_init (&ibs, idata, isize);
+
+    uint8_t *cur = (uint8_t *)odata;
+
+    unsigned dec_size = ulz_read_uleb128 (&ibs.ptr, isize);
+    if (dec_size > *osize)
+        return false;
+
+    uint8_t *end = cur + dec_size;
+    *osize = dec_size;
+
+    ulz_huff_dec_t hd;
+    bool coded = huff && br_read_bits (&ibs, 1);
+    if (ibs.exhausted || (coded && !ulz_huff_read_table (&ibs, &hd)))
+        return false;
+
+    while (cur < end)
+    {
+        uint32_t lit_len;
+        if (!ulz16u_read (&ibs, &lit_len, false) ||
+            (lit_len > (unsigned)(end - cur)))
+            return false;
+
+        if (coded)
+            while (lit_len--)
+            {
+                int c = ulz_huff_decode (&ibs, &hd);
+                if (c < 0)
+                    return false;
+                *cur++ = c;
+            }
+        else if (!br_read_bytes (&ibs, cur, lit_len))
+            return false;
+        else
+            cur += lit_len;
+
+        if (ibs.exhausted)
+            return false;
+
+        if (cur >= end)
+            break;
+
+        uint32_t ref_len, ref_ofs;
+        if (!ulz16u_read (&ibs, &ref_len, false) ||
+            ((ref_len += 2) > (unsigned)(end - cur)) ||
+            !ulz16u_read (&ibs, &ref_ofs, large))
+            return false;
+        ref_ofs += 1;
+        if ((ref_ofs == 0) || (ref_ofs > (unsigned)(cur - (const uint8_t *)hist)))
+            return false;
+
+        uint8_t *ref = cur - ref_ofs;
+        while (ref_len--)
+            *cur++ = *ref++;
+    }
+
+    return true;
+}
+
+bool ulz_decompress_huff_block (const void *idata, unsigned isize,
+                                const void *hist, void *odata, unsigned *osize)
+{
+    return ulz_decompress_var (idata, isize, hist, odata, osize, true, false);
+}
+
+bool ulz_decompress_huff (const void *idata, unsigned isize,
+                          void *odata, unsigned *osize)
+{
+    return ulz_skip_variant (&idata, &isize, ULZ_FRAME_FLAG_HUFF) &&
+           ulz_decompress_huff_block (idata, isize, odata, odata, osize);
+}
+
+bool ulz_decompress_large_block (const void *idata, unsigned isize,
+                                 const void *hist, void *odata, unsigned *osize,
+                                 bool huff)
+{
+    return ulz_decompress_var (idata, isize, hist, odata, osize, huff, true);
+}
+
+bool ulz_decompress_large (const void *idata, unsigned isize,
+                           void *odata, unsigned *osize, bool huff)
+{
+    return ulz_skip_variant (&idata, &isize,
+                             ULZ_FRAME_FLAG_LARGE | (huff ? ULZ_FRAME_FLAG_HUFF : 0)) &&
+           ulz_decompress_large_block (idata, isize, odata, odata, osize, huff);
+}
@@ -0,0 +1,45 @@
+/*
+    uLZ in-place decompression
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+#include "ulz_priv.h"
+
+unsigned ulz_inplace_size (const void *idata, unsigned isize)
+{
+    const uint8_t *src = (const uint8_t *)idata;
+    unsigned margin = ulz_read_uleb128 (&src, isize);
+    if (src == (const uint8_t *)idata)
+        return 0;
+
+    unsigned size = ulz_decompress_size (src, isize - (src - (const uint8_t *)idata));
+    if (size + margin < size)
+        return 0;
+
+    return size + margin;
+}
+
+bool ulz_decompress_inplace (void *buff, unsigned buff_size,
+                             unsigned isize, unsigned *osize)
+{
+    if (isize > buff_size)
+        return false;
+
+    const uint8_t *idata = (uint8_t *)buff + buff_size - isize;
+    unsigned need = ulz_inplace_size (idata, isize);
+    if ((need == 0) || (need > buff_size))
+        return false;
+
+    // skip the margin, it's been checked
+    const uint8_t *src = idata;
+    ulz_read_uleb128 (&src, isize);
+    isize -= src - idata;
+
+    *osize = ulz_decompress_size (src, isize);
+    return ulz_decompress_block (src, isize, buff, buff, osize);
+}
@@ -0,0 +1,112 @@
+/*
+    uLZ indexed container reader
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+#include "useful/usefun.h"
+#include "ulz_priv.h"
+
+bool ulz_ix_init (ulz_ix_t *ix, const void *data, unsigned size,
+                  void *scratch, unsigned scratch_size)
+{
+    const uint8_t *hdr = (const uint8_t *)data;
+    if ((size < ULZ_IX_HDR_SIZE) ||
+        (hdr [0] != ULZ_IX_MAGIC0) || (hdr [1] != ULZ_IX_MAGIC1) ||
+        (hdr [2] != ULZ_IX_MAGIC2) || (hdr [3] != ULZ_IX_MAGIC3) ||
+        (hdr [4] & ~(ULZ_IX_FLAG_REPOFS | ULZ_IX_FLAG_HUFF)) ||
+        (hdr [6] != 0) || (hdr [7] != 0) ||
+        (hdr [5] < ULZ_FRAME_BLK_LOG_MIN) ||
+        (hdr [5] > ULZ_FRAME_BLK_LOG_MAX) ||
+        (scratch_size < (1U << hdr [5])))
+        return false;
+
+    ix->blk_log = hdr [5];
+    ix->repofs = (hdr [4] & ULZ_IX_FLAG_REPOFS) != 0;
+    ix->huff = (hdr [4] & ULZ_IX_FLAG_HUFF) != 0;
+    ix->size = GET_UINT32_LE (hdr, 8);
+    ix->count = (ix->size >> ix->blk_log) +
+        ((ix->size & ((1U << ix->blk_log) - 1)) != 0);
+    if ((size - ULZ_IX_HDR_SIZE) / ULZ_IX_ENTRY_SIZE < ix->count)
+        return false;
+
+    ix->ofs = hdr + ULZ_IX_HDR_SIZE;
+    ix->crc = ix->ofs + ix->count * sizeof (uint32_t);
+    ix->data = ix->crc + ix->count * sizeof (uint16_t);
+    ix->data_size = size - (ix->data - hdr);
+    ix->scratch = (uint8_t *)scratch;
+    ix->cached = ULZ_IX_NONE;
+    return true;
+}
+
+/// Decode block number n into dst
+static bool ulz_ix_block (ulz_ix_t *ix, unsigned n, uint8_t *dst)
+{
+    unsigned start = n ? GET_UINT32_LE (ix->ofs, (n - 1) * sizeof (uint32_t)) : 0;
+    unsigned end = GET_UINT32_LE (ix->ofs, n * sizeof (uint32_t));
+    unsigned size = MIN (ix->size - (n << ix->blk_log), 1U << ix->blk_log);
+
+    if ((start > end) || (end > ix->data_size))
+        return false;
+
+    if (end - start == size)
+        memcpy (dst, ix->data + start, size);
+    else
+    {
+        unsigned osize = size;
+        const uint8_t *src = ix->data + start;
+        if (!(ix->huff ? ulz_decompress_huff_block (src, end - start, dst, dst, &osize) :
+              ix->repofs ? ulz_decompress_rep_block (src, end - start, dst, &osize) :
+              ulz_decompress (src, end - start, dst, &osize)) ||
+            (osize != size))
+            return false;
+    }
+
+    // ip_crc() returns the checksum in network byte order, and so it is stored
+    return ip_crc (dst, size) == ((const uint16_t *)ix->crc) [n];
+}
+
+bool ulz_read_at (ulz_ix_t *ix, unsigned offset, void *dst, unsigned len)
+{
+    if ((offset > ix->size) || (len > ix->size - offset))
+        return false;
+
+    uint8_t *out = (uint8_t *)dst;
+    unsigned blk_mask = (1U << ix->blk_log) - 1;
+    while (len)
+    {
+        unsigned n = offset >> ix->blk_log;
+        unsigned ofs = offset & blk_mask;
+        unsigned size = MIN (ix->size - (offset - ofs), blk_mask + 1);
+        unsigned count = MIN (len, size - ofs);
+
+        if ((count == size) && !((uintptr_t)out & 1))
+        {
+            // whole blocks go right to the destination, if checksum
+            // can be computed there
+            if (!ulz_ix_block (ix, n, out))
+                return false;
+        }
+        else
+        {
+            if (ix->cached != n)
+            {
+                ix->cached = ULZ_IX_NONE;
+                if (!ulz_ix_block (ix, n, ix->scratch))
+                    return false;
+                ix->cached = n;
+            }
+            memcpy (out, ix->scratch + ofs, count);
+        }
+
+        out += count;
+        offset += count;
+        len -= count;
+    }
+
+    return true;
+}
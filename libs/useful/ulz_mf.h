@@ -0,0 +1,321 @@
+/*
+    uLZ compression library: hash chain match finder
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#ifndef _ULZ_MF_H
+#define _ULZ_MF_H
+
+/* The match finder is shared by uLZ and uLZB compressors. */
+
+/// Minimal match length found by the match finder (also the hashed length)
+#define ULZ_MF_MINLEN       3
+/// 2-byte references are looked up directly, this far back at most:
+/// farther ones take more bits than the two literal bytes they replace
+#define ULZ_MF_SHORT_OFS    ULZ16U_110_LOW
+/// The farthest reference found by the match finder, unless asked otherwise
+#define ULZ_MF_OFS_MAX      (ULZ16U_MAX + 1)
+/// Hash tables larger than this don't give any noticeable gain
+#define ULZ_MF_HASH_MAX     (1U << 20)
+/// Minimal match length found by the long range finder (also the hashed length)
+#define ULZ_MF_LONG_LEN     8
+/// The long range finder remembers about one of this many positions
+#define ULZ_MF_LONG_STEP    16
+/// The long range hash table is at most this large
+#define ULZ_MF_LONG_MAX     (1U << 22)
+
+/// How many candidates to check, at most, for every input position
+#ifndef ULZ_MF_DEPTH
+#  define ULZ_MF_DEPTH      256
+#endif
+/// Maximal number of references ulz_mf_find_all() returns
+#define ULZ_MF_MATCHES      32
+
+/**
+ * Match finder state.
+ *
+ * The match finder is a classic hash chain: @a head keeps the most recent
+ * position for every hash of ULZ_MF_MINLEN bytes, and @a chain links every
+ * position to the previous one with the same hash. The chain is a ring
+ * buffer, so it remembers only the last (chain_mask + 1) positions; older
+ * candidates are still reachable through @a head, but not through the chain.
+ *
+ * References shorter than ULZ_MF_MINLEN are found by looking directly
+ * at the last ULZ_MF_SHORT_OFS positions, they don't pay farther anyway.
+ *
+ * If references may go farther than the chain can cover, there's also
+ * a long range finder: a hash table of ULZ_MF_LONG_LEN bytes at positions
+ * sampled by their hash, so that every sampled position stays there long
+ * enough to be found megabytes later. It gives one more candidate, which
+ * is taken only if it's longer than everything found through the chain.
+ *
+ * Positions are stored biased by 1, so that zero means 'no position'.
+ */
+typedef struct
+{
+    /// Start of input data (including history, if any)
+    const uint8_t *start;
+    /// Hash table heads
+    uint32_t *head;
+    /// Number of bits in hash value
+    unsigned hash_bits;
+    /// Previous position with same hash, indexed by (position & chain_mask)
+    uint32_t *chain;
+    /// Chain ring buffer size minus one
+    unsigned chain_mask;
+    /// Next position to be inserted into the hash chains
+    unsigned next;
+    /// The farthest reference to look for
+    unsigned ofs_max;
+    /// Long range hash table heads, or NULL
+    uint32_t *long_head;
+    /// Number of bits in long range hash value
+    unsigned long_bits;
+} ulz_mf_t;
+
+/// Return the largest power of two not exceeding x (x must be non-zero)
+INLINE_ALWAYS unsigned ulz_pow2_floor (unsigned x)
+{
+    return 1U << fls32 (x);
+}
+
+static inline bool ulz_mf_init (ulz_mf_t *mf, const uint8_t *start,
+                         void *workmem, unsigned workmem_size, unsigned ofs_max)
+{
+    unsigned n = workmem_size / sizeof (uint32_t);
+    if (n < 4)
+        return false;
+
+    // A quarter of memory goes to the long range finder, if needed
+    unsigned long_size = 0;
+    if (ofs_max > ULZ_MF_OFS_MAX)
+    {
+        long_size = MIN (ulz_pow2_floor (n / 4), ULZ_MF_LONG_MAX);
+        n -= long_size;
+    }
+
+    // Give half of memory to the chain, but don't make it longer
+    // than the window; the rest goes to the hash table
+    unsigned chain_size = MIN (ulz_pow2_floor (n / 2), ulz_pow2_floor (ofs_max));
+    unsigned hash_size = MIN (ulz_pow2_floor (n - chain_size), ULZ_MF_HASH_MAX);
+
+    mf->start = start;
+    mf->head = (uint32_t *)workmem;
+    mf->hash_bits = fls32 (hash_size);
+    mf->chain = mf->head + hash_size;
+    mf->chain_mask = chain_size - 1;
+    mf->next = 0;
+    mf->ofs_max = ofs_max;
+    mf->long_head = NULL;
+
+    memset (mf->head, 0, hash_size * sizeof (uint32_t));
+    if (long_size)
+    {
+        mf->long_head = mf->chain + chain_size;
+        mf->long_bits = fls32 (long_size);
+        memset (mf->long_head, 0, long_size * sizeof (uint32_t));
+    }
+    return true;
+}
+
+INLINE_ALWAYS unsigned ulz_mf_hash (ulz_mf_t *mf, const uint8_t *data)
+{
+    // written so that compiler merges the first two loads where unaligned access is fine
+    uint32_t x = (uint16_t)(data [0] | (data [1] << 8)) | ((uint32_t)data [2] << 16);
+    return (x * 2654435761U) >> (32 - mf->hash_bits);
+}
+
+/// Hash of ULZ_MF_LONG_LEN bytes; the position is sampled if low bits are 0
+INLINE_ALWAYS uint32_t ulz_mf_long_hash (const uint8_t *data)
+{
+    uint32_t x = data [0] | (data [1] << 8) | (data [2] << 16) | ((uint32_t)data [3] << 24);
+    uint32_t y = data [4] | (data [5] << 8) | (data [6] << 16) | ((uint32_t)data [7] << 24);
+    x = (x * 2654435761U) ^ (y * 2246822519U);
+    return x ^ (x >> 15);
+}
+
+/// Insert all positions up to (but not including) @a cur into hash chains
+static inline void ulz_mf_update (ulz_mf_t *mf, const uint8_t *cur, const uint8_t *end)
+{
+    if (end - mf->start < ULZ_MF_MINLEN)
+        return;
+
+    // the last ULZ_MF_MINLEN-1 positions can't be hashed
+    if (cur > end - ULZ_MF_MINLEN + 1)
+        cur = end - ULZ_MF_MINLEN + 1;
+
+    unsigned pos = cur - mf->start;
+    // same for ULZ_MF_LONG_LEN-1 positions with the long range finder
+    unsigned size = end - mf->start;
+    unsigned long_end = (size >= ULZ_MF_LONG_LEN) ? size - ULZ_MF_LONG_LEN + 1 : 0;
+    while (mf->next < pos)
+    {
+        if (mf->long_head && (mf->next < long_end))
+        {
+            uint32_t h = ulz_mf_long_hash (mf->start + mf->next);
+            if ((h & (ULZ_MF_LONG_STEP - 1)) == 0)
+                mf->long_head [h >> (32 - mf->long_bits)] = mf->next + 1;
+        }
+
+        unsigned h = ulz_mf_hash (mf, mf->start + mf->next);
+        mf->chain [mf->next & mf->chain_mask] = mf->head [h];
+        mf->head [h] = ++mf->next;
+    }
+}
+
+/**
+ * Find the nearest 2-byte reference for data at @a cur.
+ *
+ * @param mf Match finder
+ * @param cur Current data pointer
+ * @param end End of input data
+ * @param ref_ofs Receives the reference offset
+ * @return 2 if a reference was found, 0 otherwise
+ */
+static inline unsigned ulz_mf_short_find (ulz_mf_t *mf, const uint8_t *cur, const uint8_t *end,
+                                          unsigned *ref_ofs)
+{
+    if (end - cur < 2)
+        return 0;
+
+    unsigned max_ofs = MIN (MIN ((unsigned)(cur - mf->start), mf->ofs_max),
+                            (unsigned)ULZ_MF_SHORT_OFS);
+    for (unsigned ofs = 1; ofs <= max_ofs; ofs++)
+    {
+        const uint8_t *ptr = cur - ofs;
+        if ((ptr [0] == cur [0]) && (ptr [1] == cur [1]))
+        {
+            *ref_ofs = ofs;
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Check the long range finder candidate for data at @a cur.
+ *
+ * @param mf Match finder
+ * @param cur Current data pointer, already passed to ulz_mf_update()
+ * @param end End of input data
+ * @param max_len Don't compare more than this many bytes
+ * @param ref_ofs Receives the reference offset
+ * @return Reference length, or 0 if there's no candidate
+ */
+static inline unsigned ulz_mf_long_find (ulz_mf_t *mf, const uint8_t *cur, const uint8_t *end,
+                                         unsigned max_len, unsigned *ref_ofs)
+{
+    if (!mf->long_head || (end - cur < ULZ_MF_LONG_LEN))
+        return 0;
+
+    uint32_t h = ulz_mf_long_hash (cur);
+    if (h & (ULZ_MF_LONG_STEP - 1))
+        return 0;
+
+    unsigned pos = cur - mf->start;
+    unsigned cand = mf->long_head [h >> (32 - mf->long_bits)];
+    // when parsing same data again, the position may be overwritten
+    if ((cand == 0) || (cand > pos) || (pos - (cand - 1) > mf->ofs_max))
+        return 0;
+
+    const uint8_t *ptr = mf->start + cand - 1;
+    unsigned len = ulz_match_len (ptr, cur, max_len);
+
+    *ref_ofs = pos - (cand - 1);
+    return len;
+}
+
+/// A reference candidate
+typedef struct
+{
+    unsigned len;
+    unsigned ofs;
+} ulz_match_t;
+
+/**
+ * Find references to preceeding data for data at @a cur, the shortest
+ * offset for every reachable length. References are stored in order
+ * of increasing length (and increasing offset). Search stops as soon
+ * as a reference of @a nice_len bytes or longer is found.
+ *
+ * @param mf Match finder
+ * @param cur Current data pointer
+ * @param end End of input data
+ * @param nice_len Stop at references this long
+ * @param matches Receives the references
+ * @return Number of references found
+ */
+static inline unsigned ulz_mf_find_all (ulz_mf_t *mf, const uint8_t *cur, const uint8_t *end,
+                                 unsigned nice_len, ulz_match_t *matches)
+{
+    // the nearest 2-byte reference is never farther than longer ones
+    unsigned count = 0;
+    if (ulz_mf_short_find (mf, cur, end, &matches [0].ofs))
+        matches [count++].len = 2;
+
+    if (end - cur < ULZ_MF_MINLEN)
+        return count;
+
+    ulz_mf_update (mf, cur, end);
+
+    unsigned max_len = MIN ((unsigned)(end - cur), ULZ16U_MAX + 2U);
+    unsigned pos = cur - mf->start;
+    unsigned cand = mf->head [ulz_mf_hash (mf, cur)];
+    unsigned depth = ULZ_MF_DEPTH;
+    unsigned ref_len = count ? 2 : 1;
+
+    // When parsing same data again, skip positions at and after cur
+    while ((cand != 0) && (cand > pos))
+        cand = mf->chain [(cand - 1) & mf->chain_mask];
+
+    while (cand != 0)
+    {
+        cand--;
+
+        unsigned ofs = pos - cand;
+        if (ofs > mf->ofs_max)
+            break;
+
+        const uint8_t *ptr = mf->start + cand;
+
+        // only longer references are interesting, older ones are farther
+        if ((ref_len < max_len) && (ptr [ref_len] == cur [ref_len]))
+        {
+            unsigned len = ulz_match_len (ptr, cur, max_len);
+
+            if (len > ref_len)
+            {
+                matches [count].len = ref_len = len;
+                matches [count].ofs = ofs;
+                if ((++count >= ULZ_MF_MATCHES) || (len >= nice_len))
+                    break;
+            }
+        }
+
+        if ((--depth == 0) || (mf->next - cand > mf->chain_mask))
+            break;
+
+        cand = mf->chain [cand & mf->chain_mask];
+    }
+
+    // The long range candidate is the farthest one
+    if ((count < ULZ_MF_MATCHES) && (ref_len < MIN (max_len, nice_len)))
+    {
+        unsigned ofs;
+        unsigned len = ulz_mf_long_find (mf, cur, end, max_len, &ofs);
+        if (len > ref_len)
+        {
+            matches [count].len = len;
+            matches [count].ofs = ofs;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+#endif // _ULZ_MF_H
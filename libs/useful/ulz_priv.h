@@ -58,4 +58,313 @@
 #define ULZ16U_MAX          65810
 #define ULZ16U_RAW32        65811
 
+/* In the repeat offset variant of uLZ format the reference offset code
+ * ULZ_REP0 means same offset as in last reference, and ULZ_REP1 means
+ * the offset before that, which then becomes the last one. Other codes
+ * are new offsets minus one plus ULZ_REP_CODES. Both remembered offsets
+ * are initially 0, i.e. invalid.
+ */
+
+#define ULZ_REP0            0
+#define ULZ_REP1            1
+#define ULZ_REP_CODES       2
+
+/* Blocks in format variants made by ulz_compress() start with a variant
+ * header: an uleb128 decompressed size of ULZ_VARIANT_MARK, which no decoder
+ * can fit into memory, followed by a byte of ULZ_FRAME_FLAG_XXX naming
+ * the variant. Then the actual block follows. This way decoders of other
+ * variants fail on such blocks instead of producing garbage. Frames and
+ * indexed containers name the variant in their header, and their blocks
+ * go without this one.
+ */
+
+#define ULZ_VARIANT_MARK    0xFFFFFFFF
+#define ULZ_VARIANT_HDR_SIZE 6
+
+/* In the literal Huffman variant of uLZ format the bit substream starts
+ * with one bit: 0 means the block is a plain uLZ block, 1 means literal
+ * bytes are coded with a canonical Huffman code in the bit substream
+ * instead of going to the byte substream. The latter is followed by code
+ * lengths of all 256 byte values, every one a 4-bit value from 1 to
+ * ULZ_HUFF_MAXLEN; a 0 is followed by ULZ_HUFF_ZRUN_BITS more bits which
+ * give the number minus one of byte values, starting from current one,
+ * that are not used in literals. Codes are assigned in order of increasing
+ * length, then byte value, and go to the bit substream starting from
+ * the most significant bit.
+ */
+
+#define ULZ_HUFF_MAXLEN     12
+#define ULZ_HUFF_LEN_BITS   4
+#define ULZ_HUFF_ZRUN_BITS  5
+
+/* In the large window variant of uLZ format reference offsets are coded
+ * with ulz24u, which is ulz16u with the last rule split in two. Offsets
+ * up to 16 MiB then take 28 bits instead of 51 with the 32-bit escape:
+ *
+ * Code                          Bits    Low     High
+ * XX0                           3       0       3
+ * XXXX01                        6       4       19
+ * XXXXXXXX011                   11      20      275
+ * XXXXXXXXXXXXXXXX0111          20      276     65811
+ * XXXXXXXXXXXXXXXXXXXXXXXX1111  28      65812   16843027
+ *
+ * Lengths are still coded with ulz16u. Blocks start with the literal
+ * Huffman bit only if the variant is combined with that one.
+ */
+
+#define ULZ24U_0111_LOW     276
+#define ULZ24U_0111_BITS    20
+#define ULZ24U_0111_PREFIX  0b0111
+#define ULZ24U_1111_LOW     65812
+#define ULZ24U_1111_BITS    28
+#define ULZ24U_1111_PREFIX  0b1111
+#define ULZ24U_MAX          16843027
+
+#ifndef __ASSEMBLER__
+
+#include "useful/usefun.h"
+
+/// Read the uleb128 at the start of uLZ block, 0 if it is malformed
+INLINE_ALWAYS unsigned ulz_read_uleb128 (const uint8_t **idata, unsigned isize)
+{
+    uint32_t r;
+    return uleb128_n (idata, *idata + isize, &r) ? r : 0;
+}
+
+/**
+ * Skip the variant header at the start of a block.
+ * @param idata A pointer to block pointer, advanced past the header
+ * @param isize A pointer to block size, reduced by header size
+ * @param variant Expected variant, a combination of ULZ_FRAME_FLAG_XXX
+ * @return false if block doesn't start with a header of this variant
+ */
+INLINE_ALWAYS bool ulz_skip_variant (const void **idata, unsigned *isize,
+                                     unsigned variant)
+{
+    const uint8_t *src = (const uint8_t *)*idata;
+    // ULZ_VARIANT_MARK is coded as FF FF FF FF 0F
+    if ((*isize < ULZ_VARIANT_HDR_SIZE) ||
+        (GET_UINT32_LE (src, 0) != ULZ_VARIANT_MARK) || (src [4] != 0x0F) ||
+        (src [5] != variant))
+        return false;
+
+    *idata = src + ULZ_VARIANT_HDR_SIZE;
+    *isize -= ULZ_VARIANT_HDR_SIZE;
+    return true;
+}
+
+/// Huffman code for literal bytes
+typedef struct
+{
+    /// Code length for every byte value, 0 if it's not used
+    uint8_t len [256];
+    /// Code for every byte value, bit-reversed for bs_write_bits()
+    uint16_t code [256];
+} ulz_huff_t;
+
+/**
+ * Build a length-limited Huffman code for literal bytes.
+ *
+ * @param huff Receives the code
+ * @param freq Number of times every byte value occurs in literals
+ * @return The size of coded literals plus code table in bits,
+ *      or 0 if there are no literals at all
+ */
+EXTERN_C unsigned ulz_huff_build (ulz_huff_t *huff, const uint32_t *freq);
+
+#endif // __ASSEMBLER__
+
+/* An uLZB block starts with uncompressed data size (uleb128), like uLZ,
+ * followed by sequences. A sequence starts with a token byte: literal
+ * length in high nibble, reference length minus ULZB_MINMATCH in low one.
+ * Nibble value 15 means the length continues in following bytes, which
+ * are added to it up to and including the first byte which is not 255.
+ * Then go literal length extension, literal bytes, 16-bit little-endian
+ * reference offset (1 to 65535) and reference length extension.
+ * After the literal which completes the data the sequence ends.
+ */
+
+#define ULZB_MINMATCH       4
+#define ULZB_NIBBLE_MAX     15
+#define ULZB_OFS_MAX        65535
+
+/* A uLZ frame is a container for data that doesn't fit into memory as
+ * a whole. It is a sequence of uLZ blocks, every block encodes at most
+ * (1 << blk_log) bytes of data. The frame starts with a header:
+ *
+ * Offset  Size    Description
+ * 0       4       Magic bytes 'uLZf'
+ * 4       1       Flags, ULZ_FRAME_FLAG_XXX
+ * 5       1       blk_log: block size, log2
+ * 6       1       win_log: window size, log2, or 0
+ *
+ * Then blocks follow. Every block starts with an uleb128 value
+ * (size << 1) | stored. If 'stored' is 1, the block contains 'size' bytes
+ * of raw, uncompressed data. Otherwise it contains 'size' bytes of an uLZ
+ * compressed block, like those produced by ulz_compress(). A zero value
+ * terminates the frame. Neither compressed nor stored block size can
+ * exceed the block size declared in frame header.
+ *
+ * If win_log is 0, every block is self-contained. Otherwise references
+ * may point up to (1 << win_log) bytes back into data from previous blocks,
+ * so decoder has to keep that much history. Windows larger than
+ * (1 << ULZ_FRAME_WIN_LOG_MAX) bytes are allowed only in frames of
+ * the large window variant.
+ */
+
+#define ULZ_FRAME_MAGIC0    'u'
+#define ULZ_FRAME_MAGIC1    'L'
+#define ULZ_FRAME_MAGIC2    'Z'
+#define ULZ_FRAME_MAGIC3    'f'
+#define ULZ_FRAME_HDR_SIZE  7
+/// Blocks use the repeat offset variant of uLZ format
+#define ULZ_FRAME_FLAG_REPOFS 0x01
+/// Data has been passed through ulz_thumb_filter() before compression
+#define ULZ_FRAME_FLAG_THUMB 0x02
+/// Blocks use the literal Huffman variant of uLZ format
+#define ULZ_FRAME_FLAG_HUFF 0x04
+/// Blocks use the large window variant of uLZ format
+#define ULZ_FRAME_FLAG_LARGE 0x08
+
+/* An indexed uLZ container allows decoding any part of data without
+ * decoding everything before it. Data is split into blocks of (1 << blk_log)
+ * bytes (the last one may be shorter), every block is compressed separately.
+ * The container starts with a header:
+ *
+ * Offset  Size    Description
+ * 0       4       Magic bytes 'uLZi'
+ * 4       1       Flags, ULZ_IX_FLAG_XXX
+ * 5       1       blk_log: block size, log2
+ * 6       2       Reserved, must be 0
+ * 8       4       Uncompressed data size, little-endian
+ *
+ * Then follows the index, which is an array of 32-bit little-endian offsets
+ * of the end of every block, relative to the start of block data. Then goes
+ * an array of 16-bit ip_crc() checksums (in network byte order) of
+ * uncompressed data of every block.
+ * Then goes data of all blocks, one right after another. If block data size
+ * equals its uncompressed size, the block is stored, otherwise it contains
+ * an uLZ compressed block, like those produced by ulz_compress().
+ */
+
+#define ULZ_IX_MAGIC0       'u'
+#define ULZ_IX_MAGIC1       'L'
+#define ULZ_IX_MAGIC2       'Z'
+#define ULZ_IX_MAGIC3       'i'
+#define ULZ_IX_HDR_SIZE     12
+/// Index size per block: 32-bit offset and 16-bit checksum
+#define ULZ_IX_ENTRY_SIZE   6
+/// Blocks use the repeat offset variant of uLZ format
+#define ULZ_IX_FLAG_REPOFS  0x01
+/// Blocks use the literal Huffman variant of uLZ format
+#define ULZ_IX_FLAG_HUFF    0x02
+
+/* An in-place image is an uLZ block prefixed with an uleb128 margin:
+ * the amount of memory, in excess of decompressed data size, a buffer
+ * must have for the image placed at the end of the buffer to be safely
+ * decompressed to the start of same buffer. Decompressor writes output
+ * below the byte substream read pointer, never above, as long as the
+ * buffer is at least that large.
+ */
+
+/// Maximal size of in-place image header
+#define ULZ_INPLACE_HDR_MAX 5
+
+#ifndef __ASSEMBLER__
+
+/**
+ * Compress a block of data which may contain references to history data
+ * immediately preceeding the block. The history is not encoded, decoder
+ * must have it before the output buffer. Blocks in format variants are
+ * produced without the variant header.
+ *
+ * @param hist Start of history data (if equal to idata, there's no history)
+ * @param idata A pointer to input data
+ * @param isize The size of input data.
+ * @param odata A pointer to output buffer
+ * @param osize On entry, output buffer size; on exit compressed data size
+ * @param workmem Match finder working memory
+ * @param workmem_size Working memory size, bytes
+ * @param level Compression level, one of ULZ_LEVEL_XXX
+ * @return false if compressed data does not fit into output buffer,
+ *      never happens if it's at least ULZ_COMPRESS_BOUND (isize) bytes.
+ */
+EXTERN_C bool ulz_compress_block (const void *hist, const void *idata, unsigned isize,
+                                  void *odata, unsigned *osize,
+                                  void *workmem, unsigned workmem_size,
+                                  unsigned level);
+
+/**
+ * Count how many bytes are same at the start of two strings.
+ * This is where compressor spends most of its time, so platforms with
+ * a faster way to compare strings have it out of line in libs/useful/$(ARCH)/;
+ * elsewhere, e.g. on microcontrollers, the byte loop is inlined at every
+ * call. All implementations must return same result.
+ *
+ * ULZ_MATCH_LEN_EXTERN tells which way it goes. It depends on the compiler
+ * alone, so that it's same for every user of this header, whatever the
+ * make variables are; libs/useful/c/ provides the out-of-line byte loop
+ * if the compiler's target has no libs/useful/$(ARCH)/ version selected.
+ *
+ * @param a A pointer to first string
+ * @param b A pointer to second string
+ * @param max_len Don't compare more than this many bytes
+ * @return Number of matching bytes, at most max_len
+ */
+#if defined __x86_64__
+#  define ULZ_MATCH_LEN_EXTERN
+#endif
+
+#ifdef ULZ_MATCH_LEN_EXTERN
+EXTERN_C unsigned ulz_match_len (const uint8_t *a, const uint8_t *b, unsigned max_len);
+#else
+INLINE_ALWAYS unsigned ulz_match_len (const uint8_t *a, const uint8_t *b, unsigned max_len)
+{
+    unsigned len;
+    for (len = 0; (len < max_len) && (a [len] == b [len]); len++)
+        ;
+    return len;
+}
+#endif
+
+/**
+ * Decompress a block of data which may contain references to history data
+ * preceeding the output buffer. References before @a hist are considered
+ * an error.
+ *
+ * @param idata A pointer to compressed block.
+ * @param isize The size of compressed block in bytes.
+ * @param hist Start of history data (if equal to odata, there's no history)
+ * @param odata A pointer to output buffer
+ * @param osize On entry, output buffer size; on exit uncompressed data size
+ * @return false if data is damaged or does not fit into output buffer
+ */
+EXTERN_C bool ulz_decompress_block (const void *idata, unsigned isize,
+                                    const void *hist, void *odata, unsigned *osize);
+
+/**
+ * Same as ulz_decompress_rep(), but for blocks without variant header,
+ * as found in frames and indexed containers.
+ */
+EXTERN_C bool ulz_decompress_rep_block (const void *idata, unsigned isize,
+                                        void *odata, unsigned *osize);
+
+/**
+ * Same as ulz_decompress_block(), but for the literal Huffman variant
+ * of uLZ format.
+ */
+EXTERN_C bool ulz_decompress_huff_block (const void *idata, unsigned isize,
+                                         const void *hist, void *odata,
+                                         unsigned *osize);
+
+/**
+ * Same as ulz_decompress_block(), but for the large window variant
+ * of uLZ format, optionally combined with the literal Huffman one.
+ */
+EXTERN_C bool ulz_decompress_large_block (const void *idata, unsigned isize,
+                                          const void *hist, void *odata,
+                                          unsigned *osize, bool huff);
+
+#endif // __ASSEMBLER__
+
 #endif // _ULZ_PRIV_H
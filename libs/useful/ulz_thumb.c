@@ -0,0 +1,102 @@
+/*
+    Thumb branch filter for uLZ
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulz.h"
+
+unsigned ulz_thumb_filter (void *data, unsigned size, uint32_t pos, bool encode)
+{
+    uint8_t *buf = (uint8_t *)data;
+    unsigned i = 0;
+
+    while (i + 4 <= size)
+    {
+        unsigned hw1 = buf [i] | (buf [i + 1] << 8);
+        unsigned hw2 = buf [i + 2] | (buf [i + 3] << 8);
+
+        // BL is 11110Sxx xxxxxxxx 11J1J2xxx..., B.W is same with 10J1J2.
+        // Only offset bits are changed, so back conversion sees
+        // the same instructions.
+        if (((hw1 & 0xF800) != 0xF000) || ((hw2 & 0x9000) != 0x9000))
+        {
+            i += 2;
+            continue;
+        }
+
+        // Offset in halfwords: S, I1 = ~(J1 ^ S), I2 = ~(J2 ^ S), imm10, imm11
+        uint32_t s = (hw1 >> 10) & 1;
+        uint32_t ofs = (s << 23) |
+            ((~((hw2 >> 13) ^ s) & 1) << 22) |
+            ((~((hw2 >> 11) ^ s) & 1) << 21) |
+            ((hw1 & 0x3FF) << 11) | (hw2 & 0x7FF);
+
+        // PC is 4 bytes past the instruction
+        uint32_t pc = (pos + i + 4) >> 1;
+        ofs = (encode ? ofs + pc : ofs - pc) & 0xFFFFFF;
+
+        s = ofs >> 23;
+        hw1 = 0xF000 | (s << 10) | ((ofs >> 11) & 0x3FF);
+        hw2 = (hw2 & 0xD000) |
+            ((~((ofs >> 22) ^ s) & 1) << 13) |
+            ((~((ofs >> 21) ^ s) & 1) << 11) |
+            (ofs & 0x7FF);
+
+        buf [i] = hw1;
+        buf [i + 1] = hw1 >> 8;
+        buf [i + 2] = hw2;
+        buf [i + 3] = hw2 >> 8;
+        i += 4;
+    }
+
+    return i;
+}
+
+void ulz_thumb_init (ulz_thumb_t *tf, bool encode, ulz_write_t write, void *ctx)
+{
+    tf->write = write;
+    tf->ctx = ctx;
+    tf->pos = 0;
+    tf->fill = 0;
+    tf->encode = encode;
+}
+
+bool ulz_thumb_write (void *ctx, const void *data, unsigned size)
+{
+    ulz_thumb_t *tf = (ulz_thumb_t *)ctx;
+    const uint8_t *src = (const uint8_t *)data;
+
+    while (size)
+    {
+        unsigned n = MIN (size, ULZ_THUMB_BUF_SIZE - tf->fill);
+        memcpy (tf->buf + tf->fill, src, n);
+        tf->fill += n;
+        src += n;
+        size -= n;
+
+        unsigned done = ulz_thumb_filter (tf->buf, tf->fill, tf->pos, tf->encode);
+        if (done == 0)
+            break;
+        if (!tf->write (tf->ctx, tf->buf, done))
+            return false;
+
+        // Move the unprocessed tail to buffer start
+        tf->fill -= done;
+        tf->pos += done;
+        for (unsigned i = 0; i < tf->fill; i++)
+            tf->buf [i] = tf->buf [done + i];
+    }
+
+    return true;
+}
+
+bool ulz_thumb_finish (ulz_thumb_t *tf)
+{
+    unsigned fill = tf->fill;
+    tf->fill = 0;
+    return (fill == 0) || tf->write (tf->ctx, tf->buf, fill);
+}
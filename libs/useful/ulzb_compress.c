@@ -0,0 +1,172 @@
+/*
+    uLZB compression library
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include "useful/clike.h"
+#include "useful/ulzb.h"
+#include "ulz_priv.h"
+#include "ulz_mf.h"
+
+/// Don't look for longer references, they are rare and cost nothing
+#define ULZB_NICE           256
+
+/// Compressed block writer
+typedef struct
+{
+    /// Output pointer
+    uint8_t *ptr;
+    /// End of output buffer
+    uint8_t *end;
+} ulzb_writer_t;
+
+static bool ulzb_write_uleb128 (ulzb_writer_t *w, unsigned value)
+{
+    if (uleb128_len (value) > (unsigned)(w->end - w->ptr))
+        return false;
+
+    w->ptr = put_uleb128 (w->ptr, value);
+    return true;
+}
+
+/// Write the part of length that does not fit into token nibble
+static bool ulzb_write_ext (ulzb_writer_t *w, unsigned len)
+{
+    if (len < ULZB_NIBBLE_MAX)
+        return true;
+
+    len -= ULZB_NIBBLE_MAX;
+    unsigned n = len / 255 + 1;
+    if (n > (unsigned)(w->end - w->ptr))
+        return false;
+
+    for (; len >= 255; len -= 255)
+        *w->ptr++ = 255;
+    *w->ptr++ = len;
+    return true;
+}
+
+/**
+ * Put a sequence into output buffer: a literal, optionally followed
+ * by a reference (if ref_len is not 0).
+ */
+static bool ulzb_write_seq (ulzb_writer_t *w, const uint8_t *lit, unsigned lit_len,
+                            unsigned ref_len, unsigned ref_ofs)
+{
+    if (w->ptr >= w->end)
+        return false;
+
+    unsigned mlen = ref_len ? ref_len - ULZB_MINMATCH : 0;
+    *w->ptr++ = (MIN (lit_len, (unsigned)ULZB_NIBBLE_MAX) << 4) |
+        MIN (mlen, (unsigned)ULZB_NIBBLE_MAX);
+
+    if (!ulzb_write_ext (w, lit_len) ||
+        (lit_len > (unsigned)(w->end - w->ptr)))
+        return false;
+
+    memcpy (w->ptr, lit, lit_len);
+    w->ptr += lit_len;
+
+    if (ref_len == 0)
+        return true;
+
+    if (w->end - w->ptr < 2)
+        return false;
+
+    *w->ptr++ = ref_ofs;
+    *w->ptr++ = ref_ofs >> 8;
+    return ulzb_write_ext (w, mlen);
+}
+
+/// Find the longest reference which offset fits into 16 bits
+static unsigned ulzb_find (ulz_mf_t *mf, const uint8_t *cur, const uint8_t *end,
+                           unsigned *ref_ofs)
+{
+    ulz_match_t matches [ULZ_MF_MATCHES];
+    unsigned count = ulz_mf_find_all (mf, cur, end, ULZB_NICE, matches);
+
+    // Longer references go with longer offsets
+    while (count && (matches [count - 1].ofs > ULZB_OFS_MAX))
+        count--;
+    if (!count || (matches [count - 1].len < ULZB_MINMATCH))
+        return 0;
+
+    *ref_ofs = matches [count - 1].ofs;
+    return matches [count - 1].len;
+}
+
+bool ulzb_compress_wm (const void *idata, unsigned isize,
+                       void *odata, unsigned *osize,
+                       void *workmem, unsigned workmem_size,
+                       unsigned level)
+{
+    ulzb_writer_t w;
+    w.ptr = (uint8_t *)odata;
+    w.end = w.ptr + *osize;
+
+    const uint8_t *start = (const uint8_t *)idata;
+    const uint8_t *end = start + isize;
+    const uint8_t *lit = start;
+    const uint8_t *cur = start;
+    bool lazy = (level >= ULZ_LEVEL_LAZY);
+
+    ulz_mf_t mf;
+    bool ok = ulzb_write_uleb128 (&w, isize) &&
+        ulz_mf_init (&mf, start, workmem, workmem_size, ULZ_MF_OFS_MAX);
+
+    while (ok && (cur < end))
+    {
+        unsigned ref_ofs = 0;
+        unsigned ref_len = ulzb_find (&mf, cur, end, &ref_ofs);
+        if (ref_len == 0)
+        {
+            cur++;
+            continue;
+        }
+
+        // Defer the reference while a longer one starts at next position
+        unsigned next_ofs, next_len;
+        while (lazy && (next_len = ulzb_find (&mf, cur + 1, end, &next_ofs)) &&
+               (next_len > ref_len))
+        {
+            cur++;
+            ref_len = next_len;
+            ref_ofs = next_ofs;
+        }
+
+        ok = ulzb_write_seq (&w, lit, cur - lit, ref_len, ref_ofs);
+        cur += ref_len;
+        lit = cur;
+    }
+
+    // The last literal, if any
+    if (ok && (lit < end))
+        ok = ulzb_write_seq (&w, lit, end - lit, 0, 0);
+
+    // Store data as a single literal if it didn't compress
+    unsigned stored_size = 1 + 1 + isize +
+        (isize >= ULZB_NIBBLE_MAX ? (isize - ULZB_NIBBLE_MAX) / 255 + 1 : 0);
+    for (unsigned x = isize >> 7; x; x >>= 7)
+        stored_size++;
+    if (!ok || ((unsigned)(w.ptr - (uint8_t *)odata) > stored_size))
+    {
+        w.ptr = (uint8_t *)odata;
+        if (!ulzb_write_uleb128 (&w, isize) ||
+            ((isize != 0) && !ulzb_write_seq (&w, start, isize, 0, 0)))
+            return false;
+    }
+
+    *osize = w.ptr - (uint8_t *)odata;
+    return true;
+}
+
+bool ulzb_compress (const void *idata, unsigned isize,
+                    void *odata, unsigned *osize, unsigned level)
+{
+    uint32_t workmem [ULZ_WORKMEM_SIZE / sizeof (uint32_t)];
+    return ulzb_compress_wm (idata, isize, odata, osize,
+                             workmem, sizeof (workmem), level);
+}
@@ -8,12 +8,17 @@ SRC.useful$L := $(wildcard libs/useful/*.c)
 
 # Choose from alternative implementations the one that fits best current target
 useful.ALTDIR = c $(ARCH)
-useful.ALTFUN = semihosting memcpy memcmp memset memchr memrchr strlen assert_abort \
-    strcpy strncpy
+useful.ALTFUN = semihosting memcpy memmove memcmp memset memchr memrchr strlen assert_abort \
+    strcpy strncpy ulz_decompress ulzb_decompress ulz_match_len uleb128_array
 
+# Cortex-M0 lacks most of Thumb-2, it gets its own set of functions
 ifeq ($(MCU.BRAND),stm32)
+ifneq ($(filter cortex-m0%,$(MCU.CORE)),)
+useful.ALTDIR += thumb1
+else
 useful.ALTDIR += thumb
 endif
+endif
 
 define useful.FINDFILE
 $(eval _fn=)\
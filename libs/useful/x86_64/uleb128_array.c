@@ -0,0 +1,60 @@
+/*
+    A library of generally useful functions: LEB128 bulk decoding on x86_64
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include <emmintrin.h>
+#include "../leb128_priv.h"
+
+/* SSE2 is part of base x86_64, so it needs no run-time checks. High bits
+ * of 16 bytes are tested at once: if none is set, these are 16 one-byte
+ * numbers, which are just widened to 32 bits. Otherwise numbers ending
+ * within these 16 bytes are decoded with a word load each.
+ */
+unsigned uleb128_array (const uint8_t **data, const uint8_t *end,
+                        uint32_t *values, unsigned count)
+{
+    const uint8_t *src = *data;
+    const __m128i zero = _mm_setzero_si128 ();
+    unsigned i = 0;
+
+    // the last number in a block may be read with a word load
+    while ((end - src >= 16 + 8) && (count - i >= 16))
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)src);
+        unsigned more = _mm_movemask_epi8 (v);
+        if (more == 0)
+        {
+            __m128i lo = _mm_unpacklo_epi8 (v, zero);
+            __m128i hi = _mm_unpackhi_epi8 (v, zero);
+            _mm_storeu_si128 ((__m128i *)(values + i), _mm_unpacklo_epi16 (lo, zero));
+            _mm_storeu_si128 ((__m128i *)(values + i + 4), _mm_unpackhi_epi16 (lo, zero));
+            _mm_storeu_si128 ((__m128i *)(values + i + 8), _mm_unpacklo_epi16 (hi, zero));
+            _mm_storeu_si128 ((__m128i *)(values + i + 12), _mm_unpackhi_epi16 (hi, zero));
+            src += 16;
+            i += 16;
+            continue;
+        }
+
+        // there are at most 16 numbers ending in this block
+        unsigned stop = ~more & 0xFFFF;
+        if (stop == 0)
+            break;
+        const uint8_t *last = src + (31 - __builtin_clz (stop));
+        while (src <= last)
+        {
+            unsigned len = uleb128_word (src, &values [i]);
+            if (len == 0)
+                goto tail;
+            src += len;
+            i++;
+        }
+    }
+
+tail:
+    *data = src;
+    return i + uleb128_array_words (data, end, values + i, count - i);
+}
@@ -0,0 +1,54 @@
+/*
+    uLZ compression library: match length on x86_64
+    Copyright (C) 2021 Andrey Zabolotnyi
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+*/
+
+#include <emmintrin.h>
+#include "useful/clike.h"
+#include "../ulz_priv.h"
+
+/* SSE2 is part of base x86_64, so it needs no run-time checks. Most matches
+ * are short, so the first 8 bytes are compared as a single word; long
+ * matches go by 16 bytes. Loads never touch bytes past max_len.
+ */
+unsigned ulz_match_len (const uint8_t *a, const uint8_t *b, unsigned max_len)
+{
+    unsigned len = 0;
+
+    if (max_len >= 8)
+    {
+        uint64_t x, y;
+        memcpy (&x, a, 8);
+        memcpy (&y, b, 8);
+        if (x != y)
+            return __builtin_ctzll (x ^ y) >> 3;
+        len = 8;
+    }
+
+    while (len + 16 <= max_len)
+    {
+        __m128i x = _mm_loadu_si128 ((const __m128i *)(a + len));
+        __m128i y = _mm_loadu_si128 ((const __m128i *)(b + len));
+        unsigned neq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (x, y)) ^ 0xFFFF;
+        if (neq)
+            return len + __builtin_ctz (neq);
+        len += 16;
+    }
+
+    if (len + 8 <= max_len)
+    {
+        uint64_t x, y;
+        memcpy (&x, a + len, 8);
+        memcpy (&y, b + len, 8);
+        if (x != y)
+            return len + (__builtin_ctzll (x ^ y) >> 3);
+        len += 8;
+    }
+
+    while ((len < max_len) && (a [len] == b [len]))
+        len++;
+    return len;
+}
@@ -15,6 +15,9 @@ MODE = debug
 #STM32.HEAP.MIN_SIZE ?= 0
 # If needed, you may override the minimum stack size (checked at link time)
 #STM32.STACK.MIN_SIZE ?= 0x200
+# Keep initialized data compressed in flash, needs host uLZ tool in PATH or here
+#STM32.DATA.ULZ = 1
+#STM32.ULZ = $(CURDIR)/out/posix.x86_64/release/ulz
 
 # Uncomment if your compiler supports -flto code optimization, which
 # results in MUCH smaller code when compiled in release mode
@@ -0,0 +1,8 @@
+TESTS += tulz
+DESCRIPTION.tulz = Compare C and assembly uLZ decompressor speed
+FLASH.TARGETS += tulz
+IHEX.TARGETS += tulz
+
+TARGETS.tulz = tulz$E
+SRC.tulz$E = $(wildcard tests/stm32f030chev/04.ulz/*.c)
+LIBS.tulz$E = cmsis$L ugears$L useful$L
@@ -0,0 +1,10 @@
+/*
+ * The portable C uLZ decoder under different names,
+ * so that it can be compared with the one chosen by useful.mak
+ */
+
+#define ulz_decompress_size ulz_decompress_size_c
+#define ulz_decompress_block ulz_decompress_block_c
+#define ulz_decompress ulz_decompress_c
+
+#include "../../../libs/useful/c/ulz_decompress.c"
@@ -0,0 +1,71 @@
+/*
+ * Compare the speed of portable C and assembly uLZ decompressors
+ */
+
+#include "hw.h"
+#include <useful/ulz.h>
+
+// The C decoder, see ulz_c.c
+EXTERN_C bool ulz_decompress_c (const void *idata, unsigned isize,
+                                void *odata, unsigned *osize);
+
+static const char text [] =
+    "uLZ is a variant of Lempel-Ziv packer, optimized for low memory footprint, "
+    "low unpacker size and lack of computing power for decoding. The stream "
+    "consists of literals (pieces of unmodified original data) followed by "
+    "backward references (an 'offset, length' pair which is a reference back "
+    "into the already unpacked data). Even if there are several consecutive "
+    "backward references, they are interleaved with a zero-length literal, "
+    "e.g. literals and references always toggle.";
+
+static uint8_t runs [1024];
+static uint8_t comp [1024 + 64];
+static uint8_t out1 [1024], out2 [1024];
+
+static void test (const char *name, const void *data, unsigned size)
+{
+    unsigned csize = sizeof (comp);
+    if (!ulz_compress (data, size, comp, &csize, ULZ_LEVEL_LAZY))
+    {
+        printf ("%s: compression failed\r\n", name);
+        return;
+    }
+
+    unsigned osize1 = sizeof (out1);
+    unsigned osize2 = sizeof (out2);
+    uint32_t t0 = systick_counter ();
+    bool ok1 = ulz_decompress_c (comp, csize, out1, &osize1);
+    uint32_t t1 = systick_counter ();
+    bool ok2 = ulz_decompress (comp, csize, out2, &osize2);
+    uint32_t t2 = systick_counter ();
+
+    // SysTick counts down
+    unsigned c_clocks = ((t0 - t1) & SysTick_LOAD_RELOAD_Msk) * SYSTICK_DIV;
+    unsigned asm_clocks = ((t1 - t2) & SysTick_LOAD_RELOAD_Msk) * SYSTICK_DIV;
+
+    bool same = ok1 && ok2 && (osize1 == size) && (osize2 == size) &&
+        (memcmp (out1, data, size) == 0) && (memcmp (out2, data, size) == 0);
+
+    printf ("%s: %u -> %u bytes, C %u clocks, asm %u clocks%s\r\n",
+            name, size, csize, c_clocks, asm_clocks, same ? "" : ", MISMATCH");
+}
+
+int main ()
+{
+    serial_init ();
+    puts ("uLZ decompression speed test\r\n");
+
+    // Free-running SysTick, no interrupts
+    systick_config (SysTick_LOAD_RELOAD_Msk + 1);
+
+    for (unsigned i = 0, r = 0x12345678; i < sizeof (runs); r = r * 1103515245 + 12345)
+        for (unsigned n = (r >> 24) & 31; n && (i < sizeof (runs)); n--)
+            runs [i++] = r >> 16;
+
+    test ("text", text, sizeof (text) - 1);
+    test ("code", (const void *)((uintptr_t)test & ~1), 1024);
+    test ("runs", runs, sizeof (runs));
+
+    for (;;)
+        __WFI ();
+}
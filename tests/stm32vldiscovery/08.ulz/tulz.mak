@@ -0,0 +1,9 @@
+TESTS += tulz
+DESCRIPTION.tulz = Compare C and assembly uLZ decompressor speed
+FLASH.TARGETS += tulz
+IHEX.TARGETS += tulz
+
+TARGETS.tulz = tulz$E
+SRC.tulz$E = $(wildcard tests/stm32vldiscovery/08.ulz/*.c) \
+	tests/stm32vldiscovery/hw.c
+LIBS.tulz$E = cmsis$L ugears$L useful$L
@@ -0,0 +1,76 @@
+/*
+ * Measure memcpy() and memmove() speed in CPU clocks with DWT cycle counter,
+ * against the word-or-byte memcpy() that was used before
+ */
+
+#include "hw.h"
+
+// The old memcpy(), see memcpy_old.S
+EXTERN_C void memcpy_old (void *dest, const void *src, unsigned len);
+
+static uint32_t src [(1024 + 8) / 4], dst [(1024 + 8) / 4];
+
+static const unsigned sizes [] = { 4, 16, 64, 256, 1024 };
+// dest and src offsets from a word boundary
+static const uint8_t aligns [][2] = { { 0, 0 }, { 0, 1 }, { 1, 3 }, { 2, 0 } };
+
+static void copy_old (void *dest, const void *src, unsigned len)
+{ memcpy_old (dest, src, len); }
+
+static void copy_new (void *dest, const void *src, unsigned len)
+{ memcpy (dest, src, len); }
+
+static void move_up (void *dest, const void *src, unsigned len)
+{ memmove (dest, src, len); }
+
+/// Clocks taken by a copy function, less the cost of reading the counter
+static unsigned clocks (void (*copy) (void *, const void *, unsigned),
+                        void *dest, const void *src, unsigned len)
+{
+    uint32_t t0 = DWT->CYCCNT;
+    uint32_t t1 = DWT->CYCCNT;
+    copy (dest, src, len);
+    uint32_t t2 = DWT->CYCCNT;
+    return (t2 - t1) - (t1 - t0);
+}
+
+int main ()
+{
+    serial_init ();
+    puts ("memcpy speed test, clocks per call\r\n");
+
+    // Enable the cycle counter, it works without a debugger attached too
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for (unsigned i = 0; i < sizeof (src); i++)
+        ((uint8_t *)src) [i] = i * 7;
+
+    puts ("  size  dst src      old      new  memmove\r\n");
+    for (unsigned i = 0; i < ARRAY_LEN (sizes); i++)
+        for (unsigned j = 0; j < ARRAY_LEN (aligns); j++)
+        {
+            uint8_t *d = (uint8_t *)dst + aligns [j][0];
+            uint8_t *s = (uint8_t *)src + aligns [j][1];
+            unsigned len = sizes [i];
+
+            unsigned c_old = clocks (copy_old, d, s, len);
+            unsigned c_new = clocks (copy_new, d, s, len);
+            bool same = (memcmp (d, s, len) == 0);
+
+            // Overlapping move to higher addresses goes backward
+            memcpy (dst, src, sizeof (dst));
+            d = (uint8_t *)dst + 4 + aligns [j][0];
+            s = (uint8_t *)dst + aligns [j][1];
+            unsigned c_move = clocks (move_up, d, s, len);
+            same = same && (memcmp (d, (uint8_t *)src + aligns [j][1], len) == 0);
+
+            printf ("%6u %4u %3u %8u %8u %8u%s\r\n",
+                    len, aligns [j][0], aligns [j][1], c_old, c_new, c_move,
+                    same ? "" : "  MISMATCH");
+        }
+
+    for (;;)
+        __WFI ();
+}
@@ -0,0 +1,10 @@
+TESTS += tcopy
+DESCRIPTION.tcopy = Measure memcpy and memmove speed with DWT cycle counter
+FLASH.TARGETS += tcopy
+IHEX.TARGETS += tcopy
+
+TARGETS.tcopy = tcopy$E
+SRC.tcopy$E = $(wildcard tests/stm32vldiscovery/09.memcpy/*.c) \
+	tests/stm32vldiscovery/09.memcpy/memcpy_old.S \
+	tests/stm32vldiscovery/hw.c
+LIBS.tcopy$E = cmsis$L ugears$L useful$L
@@ -0,0 +1,216 @@
+#include <useful/clike.h>
+#include <useful/usefun.h>
+#include <useful/bitstream.h>
+
+#define MAX_FIELDS      1000
+
+/// One field of the random stream: a string of bits or of bytes
+typedef struct
+{
+    /// Number of bits (1..32), or 0 for bytes
+    uint8_t bits;
+    /// Number of bytes
+    uint8_t size;
+    /// Bits value, or offset of bytes in the source buffer
+    uint32_t val;
+} field_t;
+
+static uint8_t g_bytes [256];
+static field_t g_fields [MAX_FIELDS];
+static uint8_t g_buff [MAX_FIELDS * 8];
+static uint8_t g_buff2 [MAX_FIELDS * 8];
+static uint8_t g_stream [MAX_FIELDS * 8];
+static unsigned g_stream_size;
+
+/// Forward bitwriter output callback
+static bool output (void *ctx, const void *data, unsigned size)
+{
+    (void)ctx;
+    memcpy (g_stream + g_stream_size, data, size);
+    g_stream_size += size;
+    return true;
+}
+
+/// Write all fields with bitwriter_t, in bulk where possible
+static unsigned write_bw (bitwriter_t *bw, unsigned n)
+{
+    uint32_t vals [MAX_FIELDS];
+    uint8_t widths [MAX_FIELDS];
+    unsigned nf = 0;
+    for (unsigned i = 0; i < n; i++)
+    {
+        field_t *f = &g_fields [i];
+        if (f->bits)
+        {
+            vals [nf] = f->val;
+            widths [nf++] = f->bits;
+            continue;
+        }
+
+        if (!bw_write_fields (bw, vals, widths, nf) ||
+            !bw_write_bytes (bw, g_bytes + f->val, f->size))
+            return 0;
+        nf = 0;
+    }
+
+    if (!bw_write_fields (bw, vals, widths, nf))
+        return 0;
+    return bw_finish (bw);
+}
+
+static bool check_bs (unsigned n, unsigned size)
+{
+    bitstream_t bs;
+    bs_init (&bs, g_buff, size);
+    for (unsigned i = 0; i < n; i++)
+    {
+        field_t *f = &g_fields [i];
+        if (f->bits)
+        {
+            if (bs_read_bits (&bs, f->bits) != f->val)
+                return false;
+        }
+        else
+        {
+            uint8_t tmp [256];
+            if (!bs_read_bytes (&bs, tmp, f->size) ||
+                (memcmp (tmp, g_bytes + f->val, f->size) != 0))
+                return false;
+        }
+    }
+
+    return !bs.exhausted;
+}
+
+static bool check_br (const uint8_t *data, unsigned n, unsigned size, bool forward)
+{
+    bitreader_t br;
+    if (forward)
+        br_init_fwd (&br, data, size);
+    else
+        br_init (&br, data, size);
+    for (unsigned i = 0; i < n; i++)
+    {
+        field_t *f = &g_fields [i];
+        if (f->bits)
+        {
+            // fields wider than reservoir allows are read in two pieces
+            uint32_t val;
+            if (f->bits > BR_PEEK_MAX)
+            {
+                val = br_read_bits (&br, 16);
+                val |= br_read_bits (&br, f->bits - 16) << 16;
+            }
+            else
+            {
+                // peek twice, the second time with refill
+                val = br_peek_bits (&br, f->bits);
+                br_refill (&br);
+                if (br_peek_bits (&br, f->bits) != val)
+                    return false;
+                br_skip_bits (&br, f->bits);
+            }
+
+            if (val != f->val)
+                return false;
+        }
+        else
+        {
+            uint8_t tmp [256];
+            if (!br_read_bytes (&br, tmp, f->size) ||
+                (memcmp (tmp, g_bytes + f->val, f->size) != 0))
+                return false;
+        }
+    }
+
+    if (br.exhausted || (br_avail (&br) != 0) || (br.acc_bits >= 8))
+        return false;
+
+    // reading past end must be noticed
+    br_read_bits (&br, 8);
+    return br.exhausted;
+}
+
+int main ()
+{
+    xs_rng_t rng;
+    xs_init (rng, 0x12345678);
+
+    for (unsigned i = 0; i < ARRAY_LEN (g_bytes); i++)
+        g_bytes [i] = xs_rand (rng);
+
+    for (unsigned alot = 0; alot < 20000; alot++)
+    {
+        // from mostly bits to mostly bytes
+        unsigned bytes_share = alot & 7;
+        unsigned n = 1 + xs_rand (rng) % MAX_FIELDS;
+        if (alot & 8)
+            n = 1 + (n & 15);
+
+        bitstream_t bs;
+        bs_init (&bs, g_buff, sizeof (g_buff));
+        for (unsigned i = 0; i < n; i++)
+        {
+            field_t *f = &g_fields [i];
+            if ((xs_rand (rng) & 7) < bytes_share)
+            {
+                f->bits = 0;
+                f->size = xs_rand (rng) & 15;
+                f->val = xs_rand (rng) % (ARRAY_LEN (g_bytes) - f->size);
+                bs_write_bytes (&bs, g_bytes + f->val, f->size);
+            }
+            else
+            {
+                f->bits = 1 + xs_rand (rng) % 32;
+                f->val = xs_rand (rng) & (0xFFFFFFFFU >> (32 - f->bits));
+                bs_write_bits (&bs, f->bits, f->val);
+            }
+        }
+
+        unsigned size = bs_write_finish (&bs, g_buff, sizeof (g_buff));
+        if (!check_bs (n, size))
+        {
+            printf ("bs_read_xxx() failed, pass %u\n", alot);
+            return 1;
+        }
+
+        if (!check_br (g_buff, n, size, false))
+        {
+            printf ("br_read_xxx() failed, pass %u\n", alot);
+            return 1;
+        }
+
+        // same data from the fast writer
+        bitwriter_t bw;
+        bw_init (&bw, g_buff2, sizeof (g_buff2));
+        if ((write_bw (&bw, n) != size) || (memcmp (g_buff, g_buff2, size) != 0))
+        {
+            printf ("bw_write_xxx() failed, pass %u\n", alot);
+            return 1;
+        }
+
+        // too small a buffer must be noticed
+        bw_init (&bw, g_buff2, size - 1);
+        if (size && (write_bw (&bw, n) != 0))
+        {
+            printf ("bw_write_xxx() overflow not detected, pass %u\n", alot);
+            return 1;
+        }
+
+        // forward format, through a small buffer or all at once
+        g_stream_size = 0;
+        if (alot & 16)
+            bw_init_fwd (&bw, g_buff2, 8 + (xs_rand (rng) & 63), output, NULL);
+        else
+            bw_init_fwd (&bw, g_stream, sizeof (g_stream), NULL, NULL);
+        size = write_bw (&bw, n);
+        if (bw.exhausted || ((alot & 16) && (size != g_stream_size)) ||
+            !check_br (g_stream, n, size, true))
+        {
+            printf ("forward bitstream failed, pass %u\n", alot);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+# Build with: make TARGET=posix ARCH=x86_64 ...
+
+ifeq ($(TARGET),posix)
+
+TESTS += tbitstream
+DESCRIPTION.tbitstream = Check bitstream readers and writers in libuseful
+
+TARGETS.tbitstream = tbitstream$E
+SRC.tbitstream$E = $(wildcard tests/tbitstream/*.c)
+LIBS.tbitstream$E = useful$L
+
+endif
@@ -0,0 +1,147 @@
+#include <useful/clike.h>
+#include <useful/usefun.h>
+
+#define COUNT           1000
+
+/// A random number of random bit length, so that all lengths are tested
+static uint64_t rand_bits (xs_rng_t rng)
+{
+    uint64_t x = ((uint64_t)xs_rand (rng) << 32) | xs_rand (rng);
+    unsigned bits = xs_rand (rng) % 65;
+    return bits ? x >> (64 - bits) : 0;
+}
+
+static bool check_one (uint64_t x)
+{
+    uint8_t buff [LEB128_MAX_64 + 1];
+    const uint8_t *src;
+    uint8_t *end;
+    uint32_t u32;
+    int32_t s32;
+    uint64_t u64;
+    int64_t s64;
+
+    // 64-bit, both signed and unsigned
+    end = put_uleb128_64 (buff, x);
+    src = buff;
+    if ((uleb128_64 (&src) != x) || (src != end))
+        return false;
+    src = buff;
+    if (!uleb128_64_n (&src, end, &u64) || (u64 != x) || (src != end))
+        return false;
+    src = buff;
+    if (uleb128_64_n (&src, end - 1, &u64) || (src != buff))
+        return false;
+
+    end = put_sleb128_64 (buff, (int64_t)x);
+    src = buff;
+    if ((sleb128_64 (&src) != (int64_t)x) || (src != end))
+        return false;
+    src = buff;
+    if (!sleb128_64_n (&src, end, &s64) || (s64 != (int64_t)x) || (src != end))
+        return false;
+    src = buff;
+    if (sleb128_64_n (&src, end - 1, &s64))
+        return false;
+
+    // 32-bit unsigned: too large numbers must be refused by _n
+    end = put_uleb128_64 (buff, x);
+    src = buff;
+    bool fits = (x <= 0xFFFFFFFFU);
+    if (uleb128_n (&src, end, &u32) != fits)
+        return false;
+    if (fits)
+    {
+        if ((u32 != x) || (src != end) || (uleb128_len (x) != end - buff))
+            return false;
+        src = buff;
+        if ((put_uleb128 (buff, x) != end) || (uleb128 (&src) != x))
+            return false;
+    }
+
+    // 32-bit signed
+    end = put_sleb128_64 (buff, (int64_t)x);
+    src = buff;
+    fits = ((int64_t)x == (int32_t)x);
+    if (sleb128_n (&src, end, &s32) != fits)
+        return false;
+    if (fits)
+    {
+        if ((s32 != (int64_t)x) || (src != end))
+            return false;
+        src = buff;
+        if ((put_sleb128 (buff, x) != end) || (sleb128 (&src) != (int32_t)x))
+            return false;
+    }
+
+    return true;
+}
+
+int main ()
+{
+    xs_rng_t rng;
+    xs_init (rng, 0x5eb128);
+
+    for (unsigned alot = 0; alot < 1000000; alot++)
+    {
+        uint64_t x = rand_bits (rng);
+        if (!check_one (x) || !check_one (-x))
+        {
+            printf ("LEB128 of %llx failed!\n", (unsigned long long)x);
+            return 1;
+        }
+    }
+
+    // Bulk decoding
+    static uint32_t values [COUNT], out [COUNT];
+    static uint8_t buff [COUNT * LEB128_MAX_32];
+    for (unsigned alot = 0; alot < 10000; alot++)
+    {
+        // from mostly one-byte to mostly long numbers
+        unsigned small = alot & 7;
+        unsigned count = 1 + xs_rand (rng) % COUNT;
+        uint8_t *end = buff;
+        for (unsigned i = 0; i < count; i++)
+        {
+            values [i] = ((xs_rand (rng) & 7) < small) ?
+                (xs_rand (rng) & 0x7F) : (uint32_t)rand_bits (rng);
+            end = put_uleb128 (end, values [i]);
+        }
+
+        const uint8_t *src = buff;
+        if ((uleb128_array (&src, end, out, count) != count) || (src != end) ||
+            (memcmp (values, out, count * sizeof (uint32_t)) != 0))
+        {
+            printf ("uleb128_array() failed, pass %u\n", alot);
+            return 1;
+        }
+
+        // a truncated or malformed number stops decoding right before it
+        unsigned bad = xs_rand (rng) % count;
+        src = buff;
+        for (unsigned i = 0; i < bad; i++)
+            src += uleb128_len (values [i]);
+        uint8_t *bad_ptr = (uint8_t *)src;
+        unsigned bad_len = uleb128_len (values [bad]);
+        bool truncate = xs_rand (rng) & 1;
+        if (truncate)
+            end = bad_ptr + bad_len - 1;
+        else
+        {
+            // make the number 6 bytes long
+            memmove (bad_ptr + 6, bad_ptr + bad_len, end - (bad_ptr + bad_len));
+            end += 6 - bad_len;
+            memset (bad_ptr, 0x80, 6);
+            bad_ptr [5] = 0;
+        }
+
+        src = buff;
+        if ((uleb128_array (&src, end, out, count) != bad) || (src != bad_ptr))
+        {
+            printf ("uleb128_array() malformed data check failed, pass %u\n", alot);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+# Build with: make TARGET=posix ARCH=x86_64 ...
+
+ifeq ($(TARGET),posix)
+
+TESTS += tleb128
+DESCRIPTION.tleb128 = Check LEB128 encoders and decoders in libuseful
+
+TARGETS.tleb128 = tleb128$E
+SRC.tleb128$E = $(wildcard tests/tleb128/*.c)
+LIBS.tleb128$E = useful$L
+
+endif
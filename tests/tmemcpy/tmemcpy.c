@@ -0,0 +1,35 @@
+#include <useful/clike.h>
+#include <useful/usefun.h>
+
+int main ()
+{
+    xs_rng_t rng;
+    xs_init (rng, 0x11223344);
+
+    uint8_t src [256], dest [256], dest_copy [256];
+    for (unsigned i = 0; i < ARRAY_LEN (src); i++)
+        src [i] = xs_rand (rng);
+
+    for (unsigned alot = 0; alot < 1000000; alot++)
+    {
+        for (unsigned i = 0; i < ARRAY_LEN (dest); i++)
+            dest [i] = xs_rand (rng);
+        memcpy (dest_copy, dest, sizeof (dest_copy));
+
+        // mostly short copies, which are the most common
+        unsigned size = xs_rand (rng) & ((alot & 1) ? 31 : 255);
+        unsigned src_offs = xs_rand (rng) % (ARRAY_LEN (src) - size + 1);
+        unsigned dest_offs = xs_rand (rng) % (ARRAY_LEN (dest) - size + 1);
+
+        memcpy (dest + dest_offs, src + src_offs, size);
+        if ((_memcpy (dest_copy + dest_offs, src + src_offs, size) != dest_copy + dest_offs) ||
+            (memcmp (dest, dest_copy, sizeof (dest)) != 0))
+        {
+            printf ("memcpy (%p, %p, %d) failure!\n",
+                dest_copy + dest_offs, src + src_offs, size);
+            return 1;
+        }
+    }
+
+    return 0;
+}
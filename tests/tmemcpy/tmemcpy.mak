@@ -0,0 +1,12 @@
+# Build with: make TARGET=posix ARCH=x86_64 ...
+
+ifeq ($(TARGET),posix)
+
+TESTS += tmemcpy
+DESCRIPTION.tmemcpy = Check implementation of memcpy() in libuseful
+
+TARGETS.tmemcpy = tmemcpy$E
+SRC.tmemcpy$E = $(wildcard tests/tmemcpy/*.c)
+LIBS.tmemcpy$E = useful$L
+
+endif
@@ -0,0 +1,40 @@
+#include <useful/clike.h>
+#include <useful/usefun.h>
+
+int main ()
+{
+    xs_rng_t rng;
+    xs_init (rng, 0x55667788);
+
+    uint8_t buff [256], buff_copy [256];
+    for (unsigned alot = 0; alot < 1000000; alot++)
+    {
+        for (unsigned i = 0; i < ARRAY_LEN (buff) / 4; i++)
+            *(uint32_t *)&buff [i * 4] = xs_rand (rng);
+        memcpy (buff_copy, buff, sizeof (buff_copy));
+
+        // source and destination overlap most of the time, in both directions
+        unsigned size = xs_rand (rng) & ((alot & 1) ? 31 : 255);
+        unsigned src_offs = xs_rand (rng) % (ARRAY_LEN (buff) - size + 1);
+        unsigned dest_offs = (alot & 2) ?
+            xs_rand (rng) % (ARRAY_LEN (buff) - size + 1) :
+            MIN (src_offs + (xs_rand (rng) & 15), ARRAY_LEN (buff) - size);
+        if (alot & 4)
+        {
+            unsigned tmp = src_offs;
+            src_offs = dest_offs;
+            dest_offs = tmp;
+        }
+
+        memmove (buff + dest_offs, buff + src_offs, size);
+        if ((_memmove (buff_copy + dest_offs, buff_copy + src_offs, size) != buff_copy + dest_offs) ||
+            (memcmp (buff, buff_copy, sizeof (buff)) != 0))
+        {
+            printf ("memmove (%p, %p, %d) failure!\n",
+                buff_copy + dest_offs, buff_copy + src_offs, size);
+            return 1;
+        }
+    }
+
+    return 0;
+}
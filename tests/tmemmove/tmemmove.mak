@@ -0,0 +1,12 @@
+# Build with: make TARGET=posix ARCH=x86_64 ...
+
+ifeq ($(TARGET),posix)
+
+TESTS += tmemmove
+DESCRIPTION.tmemmove = Check implementation of memmove() in libuseful
+
+TARGETS.tmemmove = tmemmove$E
+SRC.tmemmove$E = $(wildcard tests/tmemmove/*.c)
+LIBS.tmemmove$E = useful$L
+
+endif
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <useful/clike.h>
+#include <useful/ulz.h>
+#include <ulzbench/ulzbench.h>
+
+#define WORKMEM_SIZE    (1024 * 1024)
+
+static const struct
+{
+    const char *title;
+    unsigned level;
+    bool fast;
+} variants [] =
+{
+    { "greedy", ULZ_LEVEL_GREEDY, false },
+    { "greedy, fast decompressor", ULZ_LEVEL_GREEDY, true },
+    { "lazy", ULZ_LEVEL_LAZY, false },
+    { "optimal", ULZ_LEVEL_OPTIMAL, false },
+    { "lazy, repeat offsets", ULZ_LEVEL_LAZY | ULZ_FLAG_REPOFS, false },
+    { "lazy, Huffman literals", ULZ_LEVEL_LAZY | ULZ_FLAG_HUFF, false },
+    { "lazy, large window", ULZ_LEVEL_LAZY | ULZ_FLAG_LARGE, false },
+    { "lazy, large window, Huffman literals",
+      ULZ_LEVEL_LAZY | ULZ_FLAG_LARGE | ULZ_FLAG_HUFF, false },
+};
+
+int main ()
+{
+    bench_data_t corpus [BENCH_CORPUS_SIZE];
+    if (!bench_corpus (corpus))
+    {
+        printf ("Not enough memory for the corpus\n");
+        bench_corpus_free (corpus);
+        return 1;
+    }
+
+    bool ok = true;
+    for (unsigned i = 0; i < ARRAY_LEN (variants); i++)
+    {
+        bench_opts_t opts =
+        {
+            .level = variants [i].level,
+            .workmem = WORKMEM_SIZE,
+            .fast = variants [i].fast,
+            .min_time = 0,
+            .fuzz = 300,
+        };
+
+        printf ("\n%s:\n", variants [i].title);
+        if (!bench (corpus, BENCH_CORPUS_SIZE, &opts))
+            ok = false;
+    }
+
+    bench_corpus_free (corpus);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+# Build with: make TARGET=posix ARCH=x86_64 ...
+
+ifeq ($(TARGET),posix)
+
+TESTS += tulzbench
+DESCRIPTION.tulzbench = uLZ round trip, speed and corrupt input check on a synthetic corpus
+
+TARGETS.tulzbench = tulzbench$E
+SRC.tulzbench$E = $(wildcard tests/tulzbench/*.c)
+LIBS.tulzbench$E = ulzbench$L useful$L
+
+endif
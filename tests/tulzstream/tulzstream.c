@@ -0,0 +1,215 @@
+#include <useful/clike.h>
+#include <useful/usefun.h>
+#include <useful/ulz.h>
+
+#define DATA_SIZE       100000
+
+/// A growing memory buffer, output function context
+typedef struct
+{
+    uint8_t *data;
+    unsigned size;
+    unsigned max;
+} buffer_t;
+
+static bool output (void *ctx, const void *data, unsigned size)
+{
+    buffer_t *buf = (buffer_t *)ctx;
+    if (buf->size + size > buf->max)
+        return false;
+    memcpy (buf->data + buf->size, data, size);
+    buf->size += size;
+    return true;
+}
+
+static uint8_t g_data [DATA_SIZE];
+static uint8_t g_frame [DATA_SIZE * 2];
+static uint8_t g_out [DATA_SIZE];
+static uint32_t g_mem [(1 << 16) + (2 << 12) + (64 << 10)];
+
+/// Text-like data with a lot of repeats, so that most blocks compress
+static void gen_data (xs_rng_t rng, uint8_t *data, unsigned size)
+{
+    static const char *words [] =
+    { "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog ", ".\n" };
+    unsigned i = 0;
+    while (i < size)
+        if (xs_rand (rng) & 15)
+        {
+            const char *w = words [xs_rand (rng) % ARRAY_LEN (words)];
+            while (*w && (i < size))
+                data [i++] = *w++;
+        }
+        else
+            data [i++] = xs_rand (rng);
+}
+
+/// Feed a frame to the decompressor in random chunks
+static bool decompress (xs_rng_t rng, const uint8_t *frame, unsigned size, buffer_t *out)
+{
+    ulz_dstream_t ds;
+    ulz_dstream_init (&ds, g_mem, sizeof (g_mem), output, out);
+
+    while (size)
+    {
+        unsigned n = MIN (size, 1 + xs_rand (rng) % 3000);
+        if (!ulz_dstream_feed (&ds, frame, n))
+            return false;
+        frame += n;
+        size -= n;
+    }
+
+    return ulz_dstream_done (&ds);
+}
+
+static bool round_trip (xs_rng_t rng, unsigned win_log, unsigned blk_log,
+                        unsigned level, unsigned size)
+{
+    buffer_t frame = { g_frame, 0, sizeof (g_frame) };
+    ulz_cstream_t cs;
+    bool valid = (win_log <= blk_log + ULZ_CSTREAM_WIN_BLK_LOG);
+    if (ulz_cstream_init (&cs, win_log, blk_log, g_mem,
+                          ULZ_CSTREAM_MEM (win_log, blk_log, 16 << 10),
+                          output, &frame) != valid)
+    {
+        printf ("ulz_cstream_init (%u, %u) %s\n", win_log, blk_log,
+                valid ? "failed" : "accepted a too large window");
+        return false;
+    }
+    if (!valid)
+        return true;
+
+    // Too little memory left for the match finder must be refused
+    if (ulz_cstream_init (&cs, win_log, blk_log, g_mem,
+                          ULZ_CSTREAM_MEM (win_log, blk_log, ULZ_CSTREAM_WORKMEM_MIN - 4),
+                          output, &frame))
+    {
+        printf ("ulz_cstream_init (%u, %u) accepted too little memory\n", win_log, blk_log);
+        return false;
+    }
+    ulz_cstream_init (&cs, win_log, blk_log, g_mem,
+                      ULZ_CSTREAM_MEM (win_log, blk_log, 16 << 10), output, &frame);
+    cs.level = level;
+
+    for (unsigned i = 0; i < size; )
+    {
+        unsigned n = MIN (size - i, xs_rand (rng) % 5000);
+        if (!ulz_cstream_feed (&cs, g_data + i, n))
+            return false;
+        i += n;
+    }
+    if (!ulz_cstream_finish (&cs))
+        return false;
+
+    buffer_t out = { g_out, 0, sizeof (g_out) };
+    if (!decompress (rng, g_frame, frame.size, &out) ||
+        (out.size != size) || (memcmp (g_out, g_data, size) != 0))
+    {
+        printf ("Round trip failed, window %u, block %u, level %x, size %u\n",
+                win_log, blk_log, level, size);
+        return false;
+    }
+
+    return true;
+}
+
+/// ulz_cstream_feed() as an output function
+static bool cstream_write (void *ctx, const void *data, unsigned size)
+{
+    return ulz_cstream_feed ((ulz_cstream_t *)ctx, data, size);
+}
+
+/// Thumb code goes through the branch filter in front of the compressor
+static bool thumb_round_trip (xs_rng_t rng, unsigned size)
+{
+    // BL instructions calling a few functions, among other halfwords
+    for (unsigned i = 0; i + 4 <= size; i += 2)
+        if ((xs_rand (rng) & 3) == 0)
+        {
+            uint32_t target = (xs_rand (rng) & 7) * 0x400;
+            uint32_t ofs = ((target - (i + 4)) >> 1) & 0x3FFFFF;
+            g_data [i + 0] = ofs >> 11;
+            g_data [i + 1] = 0xF0 | ((ofs >> 19) & 7);
+            g_data [i + 2] = ofs;
+            g_data [i + 3] = 0xF8 | ((ofs >> 8) & 7);
+            i += 2;
+        }
+        else
+        {
+            g_data [i + 0] = xs_rand (rng) & 7;
+            g_data [i + 1] = 0x20 + (xs_rand (rng) & 3);
+        }
+
+    buffer_t frame = { g_frame, 0, sizeof (g_frame) };
+    ulz_cstream_t cs;
+    ulz_thumb_t tf;
+    ulz_cstream_init (&cs, 12, 10, g_mem, sizeof (g_mem), output, &frame);
+    cs.level |= ULZ_FLAG_THUMB;
+    ulz_thumb_init (&tf, true, cstream_write, &cs);
+    for (unsigned i = 0; i < size; )
+    {
+        unsigned n = MIN (size - i, xs_rand (rng) % 5000);
+        if (!ulz_thumb_write (&tf, g_data + i, n))
+            return false;
+        i += n;
+    }
+    if (!ulz_thumb_finish (&tf) || !ulz_cstream_finish (&cs))
+        return false;
+
+    buffer_t out = { g_out, 0, sizeof (g_out) };
+    if (!decompress (rng, g_frame, frame.size, &out) ||
+        (out.size != size) || (memcmp (g_out, g_data, size) != 0))
+    {
+        printf ("Thumb filter round trip failed, size %u\n", size);
+        return false;
+    }
+
+    return true;
+}
+
+int main ()
+{
+    xs_rng_t rng;
+    xs_init (rng, 0x57eea111);
+    gen_data (rng, g_data, sizeof (g_data));
+
+    static const uint8_t win_logs [] = { 0, 10, 12, 16 };
+    static const uint8_t blk_logs [] = { 6, 8, 9, 12 };
+    static const unsigned levels [] =
+    { ULZ_LEVEL_GREEDY, ULZ_LEVEL_LAZY, ULZ_LEVEL_GREEDY | ULZ_FLAG_HUFF };
+    for (unsigned w = 0; w < ARRAY_LEN (win_logs); w++)
+        for (unsigned b = 0; b < ARRAY_LEN (blk_logs); b++)
+            for (unsigned l = 0; l < ARRAY_LEN (levels); l++)
+                if (!round_trip (rng, win_logs [w], blk_logs [b], levels [l],
+                                 xs_rand (rng) % DATA_SIZE))
+                    return 1;
+
+    for (unsigned i = 0; i < 10; i++)
+        if (!thumb_round_trip (rng, xs_rand (rng) % DATA_SIZE))
+            return 1;
+
+    // Block headers too large for 32 bits must be rejected
+    static const uint8_t bad_hdr [][5] =
+    {
+        { 0x80, 0x80, 0x80, 0x80, 0x7F },
+        { 0xFF, 0xFF, 0xFF, 0xFF, 0x10 },
+        { 0x80, 0x80, 0x80, 0x80, 0x80 },
+    };
+    buffer_t frame = { g_frame, 0, sizeof (g_frame) };
+    ulz_cstream_t cs;
+    ulz_cstream_init (&cs, 10, 9, g_mem, sizeof (g_mem), output, &frame);
+    ulz_cstream_finish (&cs);
+    for (unsigned i = 0; i < ARRAY_LEN (bad_hdr); i++)
+    {
+        // replace the terminator with a broken block header
+        memcpy (g_frame + frame.size - 1, bad_hdr [i], sizeof (bad_hdr [i]));
+        buffer_t out = { g_out, 0, sizeof (g_out) };
+        if (decompress (rng, g_frame, frame.size - 1 + sizeof (bad_hdr [i]), &out))
+        {
+            printf ("Broken block header %u accepted\n", i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+# Build with: make TARGET=posix ARCH=x86_64 ...
+
+ifeq ($(TARGET),posix)
+
+TESTS += tulzstream
+DESCRIPTION.tulzstream = uLZ streaming compressor and decompressor round trip
+
+TARGETS.tulzstream = tulzstream$E
+SRC.tulzstream$E = $(wildcard tests/tulzstream/*.c)
+LIBS.tulzstream$E = useful$L
+
+endif
@@ -83,7 +83,7 @@ FLASH.ARM-NONE-EABI-GCC ?= $(ARM-NONE-EABI-GCC.FLASH) write $1 $(if $2,$2,$(ARM-
 endif
 
 ARM-NONE-EABI-GCC.OBJCOPY ?= $(ARM-NONE-EABI-GCC.PFX)objcopy
-ARM-NONE-EABI-GCC.OCFLAGS ?= -j .isr_vector -j .text -j .ARM.extab -j .preinit_array -j .init_array -j .fini_array -j .data
+ARM-NONE-EABI-GCC.OCFLAGS ?= -j .isr_vector -j .text -j .ARM.extab -j .preinit_array -j .init_array -j .fini_array -j .data_ulz -j .data
 
 # Translate application/library pseudo-name into an actual file name
 XFNAME.ARM-NONE-EABI-GCC = $(addprefix $$(OUT),\
@@ -137,6 +137,7 @@ $(ARM-NONE-EABI-GCC.EXTRA.MKCRULES)
 endef
 
 LINK.ARM-NONE-EABI-GCC.AR = $(ARM-NONE-EABI-GCC.AR) $(ARM-NONE-EABI-GCC.ARFLAGS) $@ $^
+ifneq ($(STM32.DATA.ULZ),1)
 define LINK.ARM-NONE-EABI-GCC.EXEC
     $(ARM-NONE-EABI-GCC.LD) -o $@ \
         $(if $(filter %.ld,$^),-Wl$(COMMA)-T$(filter %.ld,$^)) \
@@ -144,6 +145,29 @@ define LINK.ARM-NONE-EABI-GCC.EXEC
         $(ARM-NONE-EABI-GCC.LDFLAGS.LIBS) $(LDFLAGS.LIBS) $2 -Wl,-Map,$@.map
     size $@
 endef
+else
+# Link with usual layout to get initialized data contents, compress them and
+# link again with the compressed image. Code and RAM addresses are same both
+# times, as the image goes to flash after everything else.
+# SystemInit () calls the decompressor, make sure it's taken from libuseful.
+define LINK.ARM-NONE-EABI-GCC.EXEC
+    $(ARM-NONE-EABI-GCC.LD) -o $@.plain \
+        -Wl$(COMMA)-T$(ARM-NONE-EABI-GCC.LDSCRIPT.PLAIN) -Wl$(COMMA)-u$(COMMA)ulz_decompress \
+        $(ARM-NONE-EABI-GCC.LDFLAGS) $(LDFLAGS) $1 $(filter-out %.ld,$^) \
+        $(ARM-NONE-EABI-GCC.LDFLAGS.LIBS) $(LDFLAGS.LIBS) $2
+    $(ARM-NONE-EABI-GCC.OBJCOPY) -O binary -j .data $@.plain $@.data
+    $(STM32.ULZ) --bare $(STM32.ULZ.FLAGS) -f -o $@.data.ulz $@.data
+    $(ARM-NONE-EABI-GCC.OBJCOPY) -I binary -O elf32-littlearm -B arm \
+        --rename-section .data=.data_ulz,alloc,load,readonly,data,contents \
+        $@.data.ulz $@.data.o
+    $(ARM-NONE-EABI-GCC.LD) -o $@ \
+        -Wl$(COMMA)-T$(ARM-NONE-EABI-GCC.LDSCRIPT) -Wl$(COMMA)-u$(COMMA)ulz_decompress \
+        $(ARM-NONE-EABI-GCC.LDFLAGS) $(LDFLAGS) $1 $(filter-out %.ld,$^) $@.data.o \
+        $(ARM-NONE-EABI-GCC.LDFLAGS.LIBS) $(LDFLAGS.LIBS) $2 -Wl,-Map,$@.map
+    rm -f $@.plain $@.data $@.data.ulz $@.data.o
+    size $@
+endef
+endif
 
 # Linking rules ($1 = target full filename, $2 = dependency list,
 # $3 = module name, $4 = unexpanded target name)
@@ -151,7 +175,7 @@ define MKLRULES.ARM-NONE-EABI-GCC
 $1: $2\
 $(if $(findstring $L,$4),
 	$(if $V,,@echo LINK.ARM-NONE-EABI-GCC.AR $$@ &&)$$(LINK.ARM-NONE-EABI-GCC.AR))\
-$(if $(findstring $E,$4), $(ARM-NONE-EABI-GCC.LDSCRIPT)
+$(if $(findstring $E,$4), $(ARM-NONE-EABI-GCC.LDSCRIPT) $(ARM-NONE-EABI-GCC.LDSCRIPT.PLAIN)
 	$(if $V,,@echo LINK.ARM-NONE-EABI-GCC.EXEC $$@ &&)\
 	$$(call LINK.ARM-NONE-EABI-GCC.EXEC,$(subst $(COMMA),$$(COMMA),$(LDFLAGS.$3) $(LDFLAGS.$4)) $(call .LIBFLAGS,LDLIBS,$3,$4),$(foreach z,$(LIBS.$3) $(LIBS.$4),$(call ARM-NONE-EABI-GCC.LINKLIB,$z))))
 $(ARM-NONE-EABI-GCC.EXTRA.MKLRULES)
@@ -209,6 +233,15 @@ $(ARM-NONE-EABI-GCC.LDSCRIPT): $(DIR.TIBS)/extra/stm32/flash.ld.in
 	$(if $V,,@echo ARM-NONE-EABI-GCC.CPP $@ &&)$(ARM-NONE-EABI-GCC.CPP) \
 		$(ARM-NONE-EABI-GCC.CPPFLAGS) -P -o $@ $<
 
+# Usual layout for the first pass of linking with compressed initialized data
+ifeq ($(STM32.DATA.ULZ),1)
+ARM-NONE-EABI-GCC.LDSCRIPT.PLAIN = $(OUT)stm32_flash_plain.ld
+
+$(ARM-NONE-EABI-GCC.LDSCRIPT.PLAIN): $(DIR.TIBS)/extra/stm32/flash.ld.in
+	$(if $V,,@echo ARM-NONE-EABI-GCC.CPP $@ &&)$(ARM-NONE-EABI-GCC.CPP) \
+		$(ARM-NONE-EABI-GCC.CPPFLAGS) -USTM32_DATA_ULZ -P -o $@ $<
+endif
+
 $(OUT)$(ARM-NONE-EABI-GCC.LIBC_INIT_ARRAY).o: $(DIR.TIBS)/extra/stm32/$(ARM-NONE-EABI-GCC.LIBC_INIT_ARRAY).c
 	$(if $V,,@echo COMPILE.ARM-NONE-EABI-GCC.CC $< &&)$(call COMPILE.ARM-NONE-EABI-GCC.CC)
 
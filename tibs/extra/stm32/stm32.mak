@@ -71,6 +71,18 @@ STM32.FLASH.END = $(word 12,$(MCU_DESC))
 STM32.HEAP.MIN_SIZE ?= 0
 STM32.STACK.MIN_SIZE ?= 0x200
 
+# Set to 1 to keep initialized data (.data) in flash compressed with uLZ,
+# SystemInit () unpacks it at reset. Firmware is linked twice: first as usual
+# to get initialized data contents, then with the compressed image instead.
+# This needs the uLZ tool for the build host (make TARGET=posix ulz).
+STM32.DATA.ULZ ?= 0
+STM32.ULZ ?= ulz
+STM32.ULZ.FLAGS ?= -l2
+
+ifeq ($(STM32.DATA.ULZ),1)
+DEFINES += STM32_DATA_ULZ
+endif
+
 # Pass MCU definitions to compiler
 DEFINES += $(MCU.DEFINES) \
 	$(call ASCIIUP,$(subst -,_,$(MCU.CORE))) \
@@ -4,14 +4,55 @@
 #include <stdbool.h>
 #include <string.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "useful/ulz.h"
 #include "useful/bitstream.h"
+#include "useful/usefun.h"
+#include "../../libs/useful/ulz_priv.h"
+#include "ulzbench/ulzbench.h"
+
+/// Largest match finder memory, KiB; keeps its size in bytes within 32 bits
+#define WORKMEM_MAX             (1024 * 1024)
+/// Most threads one may ask for
+#define THREADS_MAX             1024
+/// Largest frame batch, bytes; keeps batch sizes and offsets within 32 bits
+#define BATCH_SIZE_MAX          0x40000000U
 
 static const char *g_program;
 static int g_verbose = 0;
 static bool g_overwrite = false;
 static bool g_decompress = false;
 static const char *g_ofn = NULL;
+static unsigned g_workmem = 0;
+static unsigned g_level = ULZ_LEVEL_GREEDY;
+static unsigned g_threads = 1;
+static unsigned g_blk_log = 22;
+static unsigned g_win_log = 0;
+static bool g_large = false;
+static bool g_index = false;
+static bool g_inplace = false;
+static bool g_bare = false;
+static bool g_repofs = false;
+static bool g_thumb = false;
+static bool g_huff = false;
+static bool g_bench = false;
+static bool g_stdout = false;
+static bool g_remove = false;
+static const char *g_dict_fn = NULL;
+static uint8_t *g_dict = NULL;
+static unsigned g_dict_size = 4096;
+static const char *g_train_fn = NULL;
+
+/// Report a failed memory allocation
+static bool no_memory ()
+{
+    fprintf (stderr, "%s: Not enough memory\n", g_program);
+    return false;
+}
 
 static void display_version ()
 {
@@ -22,133 +63,1250 @@ static void display_help ()
 {
     display_version ();
     printf ("\nUsage: %s [option...] [file...]\n\n", g_program);
-    printf ("  -o# --output=#   Set alternative output file name\n");
+    printf ("File '-' is standard input, data goes to standard output then.\n"
+            "Frames are streamed with bounded memory, other formats are loaded whole.\n\n");
+    printf ("  -o# --output=#   Set alternative output file name, '-' for standard output\n");
+    printf ("  -c  --stdout     Write to standard output\n");
+    printf ("  -k  --keep       Keep input files (default)\n");
+    printf ("      --rm         Remove input files after successful de/compression\n");
+    printf ("  -p  --in-place   De/compress a single block for in-place decompression\n");
+    printf ("      --bare       Compress into a single bare block, e.g. for firmware\n");
+    printf ("  -D# --dict=#     De/compress a single block using a preset dictionary\n");
+    printf ("  -t# --train=#    Train a dictionary from sample files and save it to #\n");
+    printf ("  -s# --dict-size=# Trained dictionary size in bytes (default %u)\n", g_dict_size);
+    printf ("  -b# --block=#    Block size, log2 (%u-%u, default %u)\n",
+            ULZ_FRAME_BLK_LOG_MIN, ULZ_FRAME_BLK_LOG_MAX, g_blk_log);
+    printf ("  -w# --window=#   Frame history window, log2 (0-%u, default 0); blocks\n"
+            "                   reference previous ones, above %u large window codes\n",
+            ULZ_FRAME_WIN_LOG_LARGE_MAX, ULZ_FRAME_WIN_LOG_MAX);
     printf ("  -d  --decompress Force decompress (normally detected by extension)\n");
     printf ("  -f  --force      Force overwrite output file\n");
+    printf ("  -i  --index      Create an indexed container for random access\n");
+    printf ("  -l# --level=#    Compression level: 0 greedy, 1 lazy, 2 optimal (default %u)\n", g_level);
+    printf ("  -r  --repeat     Use repeat offset codes in frames and indexed containers\n");
+    printf ("  -H  --huffman    Huffman-code literals in frames and indexed containers\n");
+    printf ("  -F# --filter=#   Pre-filter data: 'thumb' for ARM Thumb code, 'none' (default)\n");
+    printf ("  -m# --memory=#   Match finder memory per thread, KiB (1-%u, default 4096,\n"
+            "                   or 4 bytes per window byte with large windows)\n",
+            WORKMEM_MAX);
+    printf ("  -B  --bench      Benchmark de/compression of files, or of a built-in\n"
+            "                   corpus if no files given, and fuzz the decompressor\n");
+    printf ("  -T# --threads=#  Number of threads, 0 for all CPUs (1-%u, default %u)\n",
+            THREADS_MAX, g_threads);
     printf ("  -v  --verbose    Increase verbosity level\n");
     printf ("  -V  --version    Display program version number\n");
     printf ("  -h  --help       Show this info\n");
 }
 
-static bool process (const char *fn)
+/// One block of an uLZ frame
+typedef struct
 {
-    if (g_verbose)
+    /// Block input data
+    const uint8_t *src;
+    /// Block input data size
+    unsigned src_size;
+    /// Block output data
+    uint8_t *dst;
+    /// Block output data size
+    unsigned dst_size;
+    /// Start of history for both compression and decompression
+    const uint8_t *hist;
+    /// Checksum of uncompressed block data
+    uint16_t crc;
+    /// Block is stored uncompressed
+    bool stored;
+    /// Block uses repeat offset codes
+    bool repofs;
+    /// Block uses Huffman-coded literals
+    bool huff;
+    /// Block uses large window offset codes
+    bool large;
+    /// Block has been processed by a worker
+    bool done;
+    /// Block has been processed successfully
+    bool ok;
+} block_t;
+
+/// A pool of threads processing frame blocks in parallel
+typedef struct
+{
+    /// Frame blocks
+    block_t *blocks;
+    /// Number of blocks
+    unsigned count;
+    /// Next block to be taken by a worker
+    unsigned next;
+    /// Block processing function
+    bool (*func) (block_t *blk, void *workmem);
+    /// Protects 'next' and blocks' 'done' fields
+    pthread_mutex_t lock;
+    /// Signalled every time a block is done
+    pthread_cond_t done;
+    /// Worker threads
+    pthread_t *threads;
+    /// Number of running worker threads
+    unsigned nthreads;
+} pool_t;
+
+static void *pool_worker (void *arg)
+{
+    pool_t *pool = (pool_t *)arg;
+    void *workmem = malloc (g_workmem * 1024);
+    if (!workmem)
+        no_memory ();
+
+    for (;;)
     {
-        printf ("%s ... ", fn);
-        fflush (stdout);
+        pthread_mutex_lock (&pool->lock);
+        unsigned i = pool->next++;
+        pthread_mutex_unlock (&pool->lock);
+        if (i >= pool->count)
+            break;
+
+        block_t *blk = &pool->blocks [i];
+        bool ok = workmem && pool->func (blk, workmem);
+
+        pthread_mutex_lock (&pool->lock);
+        blk->ok = ok;
+        blk->done = true;
+        pthread_cond_broadcast (&pool->done);
+        pthread_mutex_unlock (&pool->lock);
     }
 
-    const char *dot = strrchr (fn, '.');
-    if (!dot)
-        dot = strchr (fn, 0);
+    free (workmem);
+    return NULL;
+}
 
-    bool decompress = g_decompress;
-    if (!decompress && dot)
+/// Start processing blocks in at most nthreads worker threads
+static void pool_start (pool_t *pool, block_t *blocks, unsigned count,
+                        bool (*func) (block_t *blk, void *workmem), unsigned nthreads)
+{
+    pool->blocks = blocks;
+    pool->count = count;
+    pool->next = 0;
+    pool->func = func;
+    pthread_mutex_init (&pool->lock, NULL);
+    pthread_cond_init (&pool->done, NULL);
+
+    nthreads = MIN (nthreads, count);
+    pool->threads = malloc ((nthreads + 1) * sizeof (pthread_t));
+    if (!pool->threads)
+        nthreads = 0;
+    for (pool->nthreads = 0; pool->nthreads < nthreads; pool->nthreads++)
+        if (pthread_create (&pool->threads [pool->nthreads], NULL, pool_worker, pool) != 0)
+            break;
+
+    // if no thread could be started, do all the work right here
+    if (pool->nthreads == 0)
+        pool_worker (pool);
+}
+
+/// Wait until given block is processed
+static bool pool_wait (pool_t *pool, block_t *blk)
+{
+    pthread_mutex_lock (&pool->lock);
+    while (!blk->done)
+        pthread_cond_wait (&pool->done, &pool->lock);
+    pthread_mutex_unlock (&pool->lock);
+    return blk->ok;
+}
+
+/// Wait for all workers to finish, return false if any block failed
+static bool pool_finish (pool_t *pool)
+{
+    for (unsigned i = 0; i < pool->nthreads; i++)
+        pthread_join (pool->threads [i], NULL);
+    free (pool->threads);
+
+    pthread_cond_destroy (&pool->done);
+    pthread_mutex_destroy (&pool->lock);
+
+    for (unsigned i = 0; i < pool->count; i++)
+        if (!pool->blocks [i].ok)
+            return false;
+    return true;
+}
+
+static bool compress_block (block_t *blk, void *workmem)
+{
+    blk->crc = ip_crc ((void *)blk->src, blk->src_size);
+    blk->dst = malloc (blk->src_size);
+    if (!blk->dst)
+        return no_memory ();
+
+    blk->dst_size = blk->src_size;
+    if (!ulz_compress_block (blk->hist, blk->src, blk->src_size, blk->dst, &blk->dst_size,
+                             workmem, g_workmem * 1024,
+                             g_level | (g_repofs ? ULZ_FLAG_REPOFS : 0) |
+                             (g_huff ? ULZ_FLAG_HUFF : 0) | (g_large ? ULZ_FLAG_LARGE : 0)) ||
+        (blk->dst_size >= blk->src_size))
     {
-        // auto-detect whether to compress or decompress
-        decompress = (strcmp (dot, ".ulz") == 0);
+        // does not compress, store as is
+        free (blk->dst);
+        blk->dst = NULL;
+        blk->dst_size = blk->src_size;
+        blk->stored = true;
+    }
+
+    return true;
+}
+
+static bool decompress_block (block_t *blk, void *workmem)
+{
+    (void)workmem;
+
+    if (blk->stored)
+    {
+        memcpy (blk->dst, blk->src, blk->src_size);
+        return true;
+    }
+
+    unsigned osize = blk->dst_size;
+    if (blk->large)
+        return ulz_decompress_large_block (blk->src, blk->src_size, blk->hist,
+                                           blk->dst, &osize, blk->huff) &&
+               (osize == blk->dst_size);
+
+    if (blk->huff)
+        return ulz_decompress_huff_block (blk->src, blk->src_size, blk->hist,
+                                          blk->dst, &osize) &&
+               (osize == blk->dst_size);
+
+    if (blk->repofs)
+        return ulz_decompress_rep_block (blk->src, blk->src_size, blk->dst, &osize) &&
+               (osize == blk->dst_size);
+
+    return ulz_decompress_block (blk->src, blk->src_size, blk->hist, blk->dst, &osize) &&
+           (osize == blk->dst_size);
+}
+
+static bool write_uleb128 (FILE *outf, unsigned value)
+{
+    uint8_t chips [LEB128_MAX_32];
+    size_t size = put_uleb128 (chips, value) - chips;
+    return fwrite (chips, 1, size, outf) == size;
+}
+
+/// Input file, mapped into memory or read from a stream in chunks
+typedef struct
+{
+    /// Input stream, NULL if the file is mapped
+    FILE *f;
+    /// Mapped file or stream buffer
+    uint8_t *data;
+    /// Mapped file size or amount of data in stream buffer
+    size_t size;
+    /// Current position in data
+    size_t pos;
+    /// Stream buffer size
+    size_t buf_size;
+    /// Input offset of data [0]
+    uint64_t offset;
+    /// Mapped pages before this have been released
+    size_t released;
+    /// No more data in stream
+    bool eof;
+    /// Stream buffer could not be enlarged, input is incomplete
+    bool nomem;
+} input_t;
+
+/**
+ * Open an input file, "-" for standard input. Regular files are mapped
+ * into memory, privately and writable so that filters may convert data
+ * in place; pipes and devices are read in chunks.
+ */
+static bool input_open (input_t *in, const char *fn)
+{
+    memset (in, 0, sizeof (input_t));
+    if (strcmp (fn, "-") == 0)
+    {
+        in->f = stdin;
+        return true;
+    }
+
+    int fd = open (fn, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf (stderr, "%s: Can't open file: '%s'\n", g_program, fn);
+        return false;
+    }
+
+    struct stat st;
+    if ((fstat (fd, &st) == 0) && S_ISREG (st.st_mode) &&
+        (st.st_size > 0) && ((uint64_t)st.st_size <= SIZE_MAX))
+    {
+        void *map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            close (fd);
+            madvise (map, st.st_size, MADV_SEQUENTIAL);
+            in->data = map;
+            in->size = st.st_size;
+            in->eof = true;
+            return true;
+        }
+    }
+
+    in->f = fdopen (fd, "rb");
+    if (!in->f)
+    {
+        close (fd);
+        fprintf (stderr, "%s: Can't open file: '%s'\n", g_program, fn);
+        return false;
+    }
+
+    return true;
+}
+
+static void input_close (input_t *in)
+{
+    if (!in->f)
+    {
+        if (in->data)
+            munmap (in->data, in->size);
+        return;
+    }
+
+    free (in->data);
+    if (in->f != stdin)
+        fclose (in->f);
+}
+
+/**
+ * Make at least 'want' bytes after current position available, unless
+ * input ends earlier, and keep 'keep' bytes before current position.
+ * Everything before that is dropped, so memory use doesn't depend
+ * on input size.
+ *
+ * @return Number of bytes available after current position
+ */
+static size_t input_peek (input_t *in, size_t want, size_t keep)
+{
+    size_t start = in->pos - MIN (in->pos, keep);
+
+    if (!in->f)
+    {
+        // clean pages of a mapped file are dropped from memory for free
+        size_t release = start & ~((size_t)sysconf (_SC_PAGESIZE) - 1);
+        if (release > in->released)
+        {
+            madvise (in->data + in->released, release - in->released, MADV_DONTNEED);
+            in->released = release;
+        }
+        return in->size - in->pos;
+    }
+
+    if (start)
+    {
+        memmove (in->data, in->data + start, in->size - start);
+        in->size -= start;
+        in->pos -= start;
+        in->offset += start;
+    }
+
+    if (in->pos + want > in->buf_size)
+    {
+        uint8_t *data = realloc (in->data, in->pos + want);
+        if (!data)
+        {
+            // stop reading: callers see the end of input, process() the error
+            if (!in->nomem)
+                no_memory ();
+            in->nomem = in->eof = true;
+            return in->size - in->pos;
+        }
+        in->data = data;
+        in->buf_size = in->pos + want;
+    }
+
+    while (!in->eof && (in->size < in->pos + want))
+    {
+        size_t n = fread (in->data + in->size, 1, in->pos + want - in->size, in->f);
+        if (n == 0)
+            in->eof = true;
+        in->size += n;
+    }
+
+    return in->size - in->pos;
+}
+
+/**
+ * Get all the rest of input into memory, for formats which
+ * need all the data at once.
+ *
+ * @return Number of bytes after current position
+ */
+static size_t input_all (input_t *in)
+{
+    size_t want = 1U << 20;
+    while (input_peek (in, want, 0) >= want)
+        want *= 2;
+    return in->size - in->pos;
+}
+
+/// Total input size, when all of it has been read
+static uint64_t input_size (const input_t *in)
+{
+    return in->offset + in->size;
+}
+
+/// Formats other than frames keep sizes and offsets in 32 bits
+#define WHOLE_INPUT_MAX         0x7FFFFFFFU
+
+/// Number of frame blocks processed at once: enough to keep all threads busy
+static unsigned frame_batch (unsigned blk_log)
+{
+    return MIN (2 * g_threads, BATCH_SIZE_MAX >> blk_log);
+}
+
+/**
+ * Compress data into an uLZ frame. A batch of blocks is compressed
+ * in parallel, even if they reference previous ones, as the batch and
+ * the history window before it are in memory; blocks are written in order
+ * as soon as they are ready, so the output doesn't depend on the number
+ * of threads. Only one batch is in memory at a time, whatever the input size.
+ */
+static bool compress_frame (input_t *in, FILE *outf)
+{
+    unsigned blk_size = 1U << g_blk_log;
+    unsigned win_size = g_win_log ? (1U << g_win_log) : 0;
+    unsigned batch = frame_batch (g_blk_log);
+    block_t *blocks = calloc (batch, sizeof (block_t));
+    if (!blocks)
+        return no_memory ();
+    uint32_t pos = 0;
+    // this many bytes after the batch are already converted by Thumb filter
+    unsigned ahead = 0;
+
+    uint8_t hdr [ULZ_FRAME_HDR_SIZE] =
+    {
+        ULZ_FRAME_MAGIC0, ULZ_FRAME_MAGIC1, ULZ_FRAME_MAGIC2, ULZ_FRAME_MAGIC3,
+        (g_repofs ? ULZ_FRAME_FLAG_REPOFS : 0) | (g_thumb ? ULZ_FRAME_FLAG_THUMB : 0) |
+        (g_huff ? ULZ_FRAME_FLAG_HUFF : 0) | (g_large ? ULZ_FRAME_FLAG_LARGE : 0),
+        g_blk_log, g_win_log
+    };
+    bool ok = (fwrite (hdr, 1, sizeof (hdr), outf) == sizeof (hdr));
+
+    while (ok)
+    {
+        // with the instruction that may start at the end of the batch
+        size_t avail = input_peek (in, batch * blk_size + 4, win_size);
+        if (avail == 0)
+            break;
+
+        uint8_t *data = in->data + in->pos;
+        unsigned size = MIN (avail, batch * blk_size);
+        unsigned hist = MIN (in->pos, win_size);
+        if (g_thumb)
+        {
+            // convert the instruction crossing batch end too, so that
+            // blocks don't depend on batch size; then skip it next time
+            unsigned ext = MIN (avail, size + 4);
+            unsigned done = (ext > ahead) ?
+                ahead + ulz_thumb_filter (data + ahead, ext - ahead, pos + ahead, true) : ahead;
+            ahead = (done > size) ? done - size : 0;
+        }
+
+        unsigned count = (size + blk_size - 1) >> g_blk_log;
+        memset (blocks, 0, batch * sizeof (block_t));
+        for (unsigned i = 0; i < count; i++)
+        {
+            blocks [i].src = data + i * blk_size;
+            blocks [i].src_size = MIN (size - i * blk_size, blk_size);
+            blocks [i].hist = blocks [i].src - MIN (hist + i * blk_size, win_size);
+        }
+
+        pool_t pool;
+        pool_start (&pool, blocks, count, compress_block, g_threads);
+
+        for (unsigned i = 0; i < count; i++)
+        {
+            block_t *blk = &blocks [i];
+            ok = pool_wait (&pool, blk) && ok;
+
+            const void *bdata = blk->stored ? blk->src : blk->dst;
+            ok = ok &&
+                 write_uleb128 (outf, (blk->dst_size << 1) | blk->stored) &&
+                 (fwrite (bdata, 1, blk->dst_size, outf) == blk->dst_size);
+            free (blk->dst);
+        }
+
+        ok = pool_finish (&pool) && ok;
+        in->pos += size;
+        pos += size;
     }
 
+    free (blocks);
+    return ok && write_uleb128 (outf, 0);
+}
+
+/**
+ * Compress data into an indexed container. Blocks are compressed
+ * in parallel, the container is written when all of them are ready.
+ */
+static bool compress_index (const uint8_t *data, unsigned size, FILE *outf)
+{
+    unsigned blk_size = 1U << g_blk_log;
+    unsigned count = (unsigned)(((uint64_t)size + blk_size - 1) >> g_blk_log);
+    block_t *blocks = calloc (count + 1, sizeof (block_t));
+    if (!blocks)
+        return no_memory ();
+    for (unsigned i = 0; i < count; i++)
+    {
+        blocks [i].src = data + i * blk_size;
+        blocks [i].src_size = MIN (size - i * blk_size, blk_size);
+        blocks [i].hist = blocks [i].src;
+    }
+
+    pool_t pool;
+    pool_start (&pool, blocks, count, compress_block, g_threads);
+    bool ok = pool_finish (&pool);
+
+    unsigned index_size = ULZ_IX_HDR_SIZE + count * ULZ_IX_ENTRY_SIZE;
+    uint8_t *index = calloc (index_size, 1);
+    if (!index)
+    {
+        for (unsigned i = 0; i < count; i++)
+            free (blocks [i].dst);
+        free (blocks);
+        return no_memory ();
+    }
+
+    index [0] = ULZ_IX_MAGIC0;
+    index [1] = ULZ_IX_MAGIC1;
+    index [2] = ULZ_IX_MAGIC2;
+    index [3] = ULZ_IX_MAGIC3;
+    index [4] = (g_repofs ? ULZ_IX_FLAG_REPOFS : 0) | (g_huff ? ULZ_IX_FLAG_HUFF : 0);
+    index [5] = g_blk_log;
+    PUT_UINT32_LE (index, 8, size);
+
+    uint8_t *ofs = index + ULZ_IX_HDR_SIZE;
+    uint16_t *crc = (uint16_t *)(ofs + count * sizeof (uint32_t));
+    unsigned end = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        end += blocks [i].dst_size;
+        PUT_UINT32_LE (ofs, i * sizeof (uint32_t), end);
+        crc [i] = blocks [i].crc;
+    }
+
+    ok = ok && (fwrite (index, 1, index_size, outf) == index_size);
+    free (index);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        block_t *blk = &blocks [i];
+        const void *bdata = blk->stored ? blk->src : blk->dst;
+        ok = ok && (fwrite (bdata, 1, blk->dst_size, outf) == blk->dst_size);
+        free (blk->dst);
+    }
+
+    free (blocks);
+    return ok;
+}
+
+/// Compress data into a single in-place image
+static bool compress_inplace (const uint8_t *data, unsigned size, FILE *outf)
+{
+    unsigned osize = size + size / 8 + 64;
+    uint8_t *out = malloc (osize);
+    void *workmem = malloc (g_workmem * 1024);
+    bool ok = (out && workmem) || no_memory ();
+    ok = ok &&
+        ulz_compress_inplace (data, size, out, &osize,
+                              workmem, g_workmem * 1024, g_level) &&
+        (fwrite (out, 1, osize, outf) == osize);
+    free (workmem);
+    free (out);
+    return ok;
+}
+
+/// Compress data into a single bare block, to be unpacked with ulz_decompress()
+static bool compress_bare (const uint8_t *data, unsigned size, FILE *outf)
+{
+    unsigned osize = size + size / 8 + 64;
+    uint8_t *out = malloc (osize);
+    void *workmem = malloc (g_workmem * 1024);
+    bool ok = (out && workmem) || no_memory ();
+    ok = ok &&
+        ulz_compress_wm (data, size, out, &osize,
+                         workmem, g_workmem * 1024, g_level) &&
+        (fwrite (out, 1, osize, outf) == osize);
+    free (workmem);
+    free (out);
+    return ok;
+}
+
+/// Compress data into a single block using the preset dictionary
+static bool compress_dict (const uint8_t *data, unsigned size, FILE *outf)
+{
+    unsigned osize = size + size / 8 + 64;
+    // room for dictionary and data plus match finder memory
+    uint64_t wsize = (uint64_t)g_workmem * 1024 + g_dict_size + size + 4;
+    if (wsize > UINT32_MAX)
+        return no_memory ();
+
+    uint8_t *out = malloc (osize);
+    void *workmem = malloc (wsize);
+    bool ok = (out && workmem) || no_memory ();
+    ok = ok &&
+        ulz_compress_dict (g_dict, g_dict_size, data, size, out, &osize,
+                           workmem, wsize, g_level) &&
+        (fwrite (out, 1, osize, outf) == osize);
+    free (workmem);
+    free (out);
+    return ok;
+}
+
+/**
+ * Decompress a block compressed with the preset dictionary.
+ *
+ * @return Decompressed data (to be freed by caller) or NULL on error
+ */
+static uint8_t *decompress_dict (const uint8_t *data, unsigned size,
+                                 unsigned *outf_size)
+{
+    *outf_size = ulz_decompress_size (data, size);
+    if (*outf_size > WHOLE_INPUT_MAX)
+        return NULL;
+
+    *outf_size += MIN (g_dict_size, ULZ_DICT_MAX);
+    uint8_t *buff = malloc (*outf_size + 1);
+    if (!buff)
+    {
+        no_memory ();
+        return NULL;
+    }
+
+    if (!ulz_decompress_dict (g_dict, g_dict_size, data, size, buff, outf_size))
+    {
+        free (buff);
+        return NULL;
+    }
+
+    return buff;
+}
+
+/**
+ * Decompress an in-place image the way a loader would: put it at the end
+ * of a just large enough buffer and decompress it there.
+ *
+ * @return Decompressed data (to be freed by caller) or NULL on error
+ */
+static uint8_t *decompress_inplace (const uint8_t *data, unsigned size,
+                                    unsigned *outf_size)
+{
+    unsigned buff_size = MAX (ulz_inplace_size (data, size), size);
+    if (buff_size > WHOLE_INPUT_MAX)
+        return NULL;
+
+    uint8_t *buff = malloc (buff_size + 1);
+    if (!buff)
+    {
+        no_memory ();
+        return NULL;
+    }
+
+    memcpy (buff + buff_size - size, data, size);
+    if (!ulz_decompress_inplace (buff, buff_size, size, outf_size))
+    {
+        free (buff);
+        return NULL;
+    }
+
+    return buff;
+}
+
+/// ulz_write_t for writing to a file
+static bool write_file (void *ctx, const void *data, unsigned size)
+{
+    return fwrite (data, 1, size, (FILE *)ctx) == size;
+}
+
+/**
+ * Decompress an uLZ frame, writing out every batch of blocks as soon
+ * as it is ready. Self-contained blocks are decompressed in parallel,
+ * if blocks reference previous data they go one by one. Only one batch
+ * and the history window before it are in memory at a time.
+ */
+static bool decompress_frame (input_t *in, FILE *outf)
+{
+    if (input_peek (in, ULZ_FRAME_HDR_SIZE, 0) < ULZ_FRAME_HDR_SIZE)
+        return false;
+
+    const uint8_t *hdr = in->data + in->pos;
+    unsigned blk_log = hdr [5];
+    unsigned win_log = hdr [6];
+    bool repofs = (hdr [4] & ULZ_FRAME_FLAG_REPOFS) != 0;
+    bool thumb = (hdr [4] & ULZ_FRAME_FLAG_THUMB) != 0;
+    bool huff = (hdr [4] & ULZ_FRAME_FLAG_HUFF) != 0;
+    bool large = (hdr [4] & ULZ_FRAME_FLAG_LARGE) != 0;
+    // repeat offset decoder does not support history
+    if ((hdr [4] & ~(ULZ_FRAME_FLAG_REPOFS | ULZ_FRAME_FLAG_THUMB |
+                     ULZ_FRAME_FLAG_HUFF | ULZ_FRAME_FLAG_LARGE)) ||
+        (repofs && (win_log || huff || large)) ||
+        (blk_log < ULZ_FRAME_BLK_LOG_MIN) || (blk_log > ULZ_FRAME_BLK_LOG_MAX) ||
+        (win_log > (large ? ULZ_FRAME_WIN_LOG_LARGE_MAX : ULZ_FRAME_WIN_LOG_MAX)))
+        return false;
+    in->pos += ULZ_FRAME_HDR_SIZE;
+
+    unsigned blk_size = 1U << blk_log;
+    unsigned win_size = win_log ? (1U << win_log) : 0;
+    unsigned batch = frame_batch (blk_log);
+    // a block with its header takes at most this much input
+    size_t batch_isize = (size_t)batch * (blk_size + 5);
+    block_t *blocks = calloc (batch, sizeof (block_t));
+    uint8_t *out = malloc (win_size + (size_t)batch * blk_size);
+    if (!blocks || !out)
+    {
+        no_memory ();
+        goto broken;
+    }
+
+    unsigned hist = 0;
+
+    ulz_thumb_t tf;
+    ulz_thumb_init (&tf, false, write_file, outf);
+
+    bool ok = true, end = false;
+    while (ok && !end)
+    {
+        size_t avail = input_peek (in, batch_isize, 0);
+        const uint8_t *data = in->data + in->pos;
+        const uint8_t *data_end = data + avail;
+        unsigned count = 0;
+        unsigned total = 0;
+
+        // Collect a batch of blocks to know where every block goes
+        while (count < batch)
+        {
+            const uint8_t *cur = data;
+            unsigned bhdr = ulz_read_uleb128 (&cur, MIN (data_end - data, 5U));
+            if (cur == data)
+                goto broken;
+            data = cur;
+            if (bhdr == 0)
+            {
+                end = true;
+                break;
+            }
+
+            unsigned bsize = bhdr >> 1;
+            if ((bsize > blk_size) || (bsize > (size_t)(data_end - data)))
+                goto broken;
+
+            block_t *blk = &blocks [count++];
+            memset (blk, 0, sizeof (block_t));
+            blk->src = data;
+            blk->src_size = bsize;
+            blk->stored = bhdr & 1;
+            blk->repofs = repofs;
+            blk->huff = huff;
+            blk->large = large;
+            blk->dst_size = blk->stored ? bsize : ulz_decompress_size (data, bsize);
+            if (blk->dst_size > blk_size)
+                goto broken;
+
+            blk->dst = out + hist + total;
+            blk->hist = win_log ? blk->dst - MIN (hist + total, win_size) : blk->dst;
+            total += blk->dst_size;
+            data += bsize;
+        }
+
+        pool_t pool;
+        pool_start (&pool, blocks, count, decompress_block, win_log ? 1 : g_threads);
+        if (!pool_finish (&pool))
+            goto broken;
+        in->pos = data - in->data;
+
+        ok = thumb ? ulz_thumb_write (&tf, out + hist, total) :
+            (fwrite (out + hist, 1, total, outf) == total);
+
+        // Keep the window for next batch
+        unsigned keep = MIN (hist + total, win_size);
+        memmove (out, out + hist + total - keep, keep);
+        hist = keep;
+    }
+
+    if (thumb)
+        ok = ulz_thumb_finish (&tf) && ok;
+
+    free (out);
+    free (blocks);
+    return ok;
+
+broken:
+    free (out);
+    free (blocks);
+    return false;
+}
+
+/**
+ * Decompress an indexed container piece by piece, the way random access
+ * reader would do it.
+ */
+static bool decompress_index (const uint8_t *data, unsigned size, FILE *outf)
+{
+    ulz_ix_t ix;
+    void *scratch = malloc (1U << ULZ_FRAME_BLK_LOG_MAX);
+    void *buff = malloc (1U << ULZ_FRAME_BLK_LOG_MAX);
+    bool ok = (scratch && buff) || no_memory ();
+    ok = ok && ulz_ix_init (&ix, data, size, scratch, 1U << ULZ_FRAME_BLK_LOG_MAX);
+    for (unsigned ofs = 0; ok && (ofs < ix.size); )
+    {
+        unsigned len = MIN (ix.size - ofs, 1U << ix.blk_log);
+        ok = ulz_read_at (&ix, ofs, buff, len) &&
+             (fwrite (buff, 1, len, outf) == len);
+        ofs += len;
+    }
+
+    free (buff);
+    free (scratch);
+    return ok;
+}
+
+/**
+ * Load whole file into memory.
+ *
+ * @return File contents (to be freed by caller) or NULL on error
+ */
+static uint8_t *load_file (const char *fn, unsigned *size)
+{
     FILE *inf = fopen (fn, "rb");
     if (!inf)
     {
-        if (g_verbose)
-            printf ("ERROR\n");
         fprintf (stderr, "%s: Can't open file: '%s'\n", g_program, fn);
-        return false;
+        return NULL;
     }
 
     fseek (inf, 0, SEEK_END);
-    unsigned inf_size = ftell (inf);
+    *size = ftell (inf);
     fseek (inf, 0, SEEK_SET);
 
-    void *inf_buf = malloc (inf_size);
-    unsigned bytes_read = fread (inf_buf, 1, inf_size, inf);
+    uint8_t *buf = malloc (*size + 1);
+    if (!buf)
+    {
+        fclose (inf);
+        no_memory ();
+        return NULL;
+    }
+
+    unsigned bytes_read = fread (buf, 1, *size, inf);
     fclose (inf);
 
-    if (bytes_read != inf_size)
+    if (bytes_read != *size)
     {
-        free (inf_buf);
-        if (g_verbose)
-            printf ("ERROR\n");
+        free (buf);
         fprintf (stderr, "%s: Can't read %u bytes from file '%s'\n",
-                 g_program, inf_size, fn);
-        return false;
+                 g_program, *size, fn);
+        return NULL;
     }
 
-    char ofn_buff [FILENAME_MAX + 1];
-    const char *ofn = g_ofn ? g_ofn : ofn_buff;
+    return buf;
+}
 
-    void *outf_buf;
-    unsigned outf_size = 0;
-    if (decompress)
+/// Dictionary training: length of substrings counted in samples
+#define TRAIN_DMER              6
+/// Dictionary training: length of pieces copied from samples to dictionary
+#define TRAIN_SEGMENT           48
+/// Dictionary training: log2 of substring hash table size
+#define TRAIN_HASH_LOG          20
+
+/// A piece of sample data selected for the dictionary
+typedef struct
+{
+    unsigned pos;
+    unsigned score;
+} train_seg_t;
+
+static int train_seg_cmp (const void *a, const void *b)
+{
+    unsigned sa = ((const train_seg_t *)a)->score;
+    unsigned sb = ((const train_seg_t *)b)->score;
+    return (sa > sb) - (sa < sb);
+}
+
+/**
+ * Train a dictionary from sample files. Samples are split into
+ * dict_size / TRAIN_SEGMENT epochs, and from every epoch the segment
+ * which contains most of yet uncovered frequently repeated substrings
+ * is taken. Most valuable segments go to the end of dictionary,
+ * where they can be reached with the shortest offsets.
+ */
+static bool train_dict (char *const *files, unsigned count)
+{
+    uint8_t *corpus = NULL;
+    unsigned size = 0;
+    // hash of substring starting at every position, 0 if crosses sample end
+    uint32_t *dmer = NULL;
+
+    for (unsigned i = 0; i < count; i++)
     {
-        snprintf (ofn_buff, sizeof (ofn_buff), "%.*s", (int)(dot - fn), fn);
-        outf_size = ulz_decompress_size (inf_buf, inf_size);
-        outf_buf = malloc (outf_size);
-        if (!ulz_decompress (inf_buf, inf_size, outf_buf, &outf_size))
+        unsigned fsize;
+        uint8_t *fdata = load_file (files [i], &fsize);
+        if (!fdata)
         {
-            free (inf_buf);
-            free (outf_buf);
-            if (g_verbose)
-                printf ("broken\n");
-            else
-                fprintf (stderr, "%s: Packed file '%s' cannot be uncompressed\n",
-                         g_program, fn);
+            free (corpus);
+            free (dmer);
             return false;
         }
+
+        uint8_t *new_corpus = realloc (corpus, size + fsize);
+        if (new_corpus)
+            corpus = new_corpus;
+        uint32_t *new_dmer = realloc (dmer, (size + fsize) * sizeof (uint32_t));
+        if (new_dmer)
+            dmer = new_dmer;
+        if (!new_corpus || !new_dmer)
+        {
+            free (fdata);
+            free (corpus);
+            free (dmer);
+            return no_memory ();
+        }
+
+        memcpy (corpus + size, fdata, fsize);
+        for (unsigned j = 0; j < fsize; j++)
+            if (j + TRAIN_DMER > fsize)
+                dmer [size + j] = 0;
+            else
+            {
+                uint64_t v = 0;
+                memcpy (&v, fdata + j, TRAIN_DMER);
+                dmer [size + j] = 1 + (uint32_t)((v * 0xcf1bbcdcb7a56463ULL) >>
+                                                 (64 - TRAIN_HASH_LOG));
+            }
+
+        size += fsize;
+        free (fdata);
+    }
+
+    unsigned dsize = 0;
+    uint8_t *dict = malloc (g_dict_size);
+    if (!dict)
+    {
+        free (dmer);
+        free (corpus);
+        return no_memory ();
+    }
+
+    if (size <= g_dict_size)
+    {
+        // nothing to choose from
+        memcpy (dict, corpus, size);
+        dsize = size;
     }
     else
     {
-        snprintf (ofn_buff, sizeof (ofn_buff), "%s.ulz", fn);
-        outf_buf = malloc (outf_size = inf_size);
-        if (!ulz_compress (inf_buf, inf_size, outf_buf, &outf_size))
+        // substring occurences in samples, and in current window
+        uint32_t *freq = calloc ((1U << TRAIN_HASH_LOG) + 1, sizeof (uint32_t));
+        uint16_t *inwin = calloc ((1U << TRAIN_HASH_LOG) + 1, sizeof (uint16_t));
+        unsigned nseg = MAX (g_dict_size / TRAIN_SEGMENT, 1);
+        train_seg_t *segs = malloc (nseg * sizeof (train_seg_t));
+        if (!freq || !inwin || !segs)
         {
-            free (inf_buf);
-            free (outf_buf);
-            if (g_verbose)
-                printf ("incompressible\n");
-            else
-                fprintf (stderr, "%s: File '%s' does not compress\n",
-                         g_program, fn);
+            free (segs);
+            free (inwin);
+            free (freq);
+            free (dict);
+            free (dmer);
+            free (corpus);
+            return no_memory ();
+        }
+
+        for (unsigned i = 0; i < size; i++)
+            freq [dmer [i]]++;
+        // substrings occuring just once are useless
+        for (unsigned i = 0; i <= (1U << TRAIN_HASH_LOG); i++)
+            if (freq [i])
+                freq [i]--;
+        freq [0] = 0;
+
+        unsigned epoch = MAX (size / nseg, TRAIN_SEGMENT);
+        unsigned window = TRAIN_SEGMENT - TRAIN_DMER + 1;
+        unsigned n = 0;
+
+        for (unsigned beg = 0; (n < nseg) && (beg + TRAIN_SEGMENT <= size); beg += epoch)
+        {
+            unsigned end = MIN (beg + epoch, size - TRAIN_SEGMENT + 1);
+            unsigned score = 0, best_score = 0, best_pos = beg;
+
+            // slide the window, counting every distinct substring once
+            for (unsigned i = beg; i < end + window - 1; i++)
+            {
+                if (inwin [dmer [i]]++ == 0)
+                    score += freq [dmer [i]];
+                if (i < beg + window - 1)
+                    continue;
+
+                unsigned pos = i + 1 - window;
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best_pos = pos;
+                }
+
+                if (--inwin [dmer [pos]] == 0)
+                    score -= freq [dmer [pos]];
+            }
+            for (unsigned i = end; i < end + window - 1; i++)
+                inwin [dmer [i]] = 0;
+
+            if (best_score == 0)
+                continue;
+
+            // substrings already in dictionary don't count anymore
+            for (unsigned i = best_pos; i < best_pos + window; i++)
+                freq [dmer [i]] = 0;
+
+            segs [n].pos = best_pos;
+            segs [n].score = best_score;
+            n++;
+        }
+
+        qsort (segs, n, sizeof (train_seg_t), train_seg_cmp);
+        for (unsigned i = 0; i < n; i++)
+        {
+            memcpy (dict + dsize, corpus + segs [i].pos, TRAIN_SEGMENT);
+            dsize += TRAIN_SEGMENT;
+        }
+
+        free (segs);
+        free (inwin);
+        free (freq);
+    }
+
+    free (dmer);
+    free (corpus);
+
+    bool ok = false;
+    FILE *outf = fopen (g_train_fn, "wb");
+    if (outf)
+    {
+        ok = (fwrite (dict, 1, dsize, outf) == dsize);
+        if (fclose (outf) != 0)
+            ok = false;
+    }
+    free (dict);
+
+    if (!ok)
+        fprintf (stderr, "%s: Can't write dictionary to '%s'\n", g_program, g_train_fn);
+    else if (g_verbose)
+        printf ("%s: %u bytes dictionary from %u bytes of samples\n",
+                g_train_fn, dsize, size);
+
+    return ok;
+}
+
+/// Compress input in the selected format
+static bool compress_file (input_t *in, FILE *outf)
+{
+    if (!g_dict && !g_inplace && !g_index && !g_bare)
+        return compress_frame (in, outf);
+
+    size_t size = input_all (in);
+    if (size > WHOLE_INPUT_MAX)
+    {
+        fprintf (stderr, "%s: Input too large, only frames may be larger than %u bytes\n",
+                 g_program, WHOLE_INPUT_MAX);
+        return false;
+    }
+
+    uint8_t *data = in->data + in->pos;
+    if (g_thumb)
+        ulz_thumb_filter (data, size, 0, true);
+
+    return g_dict ? compress_dict (data, size, outf) :
+        g_inplace ? compress_inplace (data, size, outf) :
+        g_bare ? compress_bare (data, size, outf) :
+        compress_index (data, size, outf);
+}
+
+/// Check if input at current position starts with given magic bytes
+static bool input_magic (input_t *in, unsigned hdr_size, uint8_t m0, uint8_t m1,
+                         uint8_t m2, uint8_t m3)
+{
+    if (input_peek (in, hdr_size, 0) < hdr_size)
+        return false;
+
+    const uint8_t *data = in->data + in->pos;
+    return (data [0] == m0) && (data [1] == m1) && (data [2] == m2) && (data [3] == m3);
+}
+
+/// Decompress input, detecting its format
+static bool decompress_file (input_t *in, FILE *outf)
+{
+    if (!g_dict && !g_inplace &&
+        input_magic (in, ULZ_FRAME_HDR_SIZE, ULZ_FRAME_MAGIC0, ULZ_FRAME_MAGIC1,
+                     ULZ_FRAME_MAGIC2, ULZ_FRAME_MAGIC3))
+    {
+        // frames may follow one another, e.g. from several files compressed with -c
+        do
+            if (!decompress_frame (in, outf))
+                return false;
+        while (input_magic (in, ULZ_FRAME_HDR_SIZE, ULZ_FRAME_MAGIC0, ULZ_FRAME_MAGIC1,
+                            ULZ_FRAME_MAGIC2, ULZ_FRAME_MAGIC3));
+
+        return input_peek (in, 1, 0) == 0;
+    }
+
+    size_t size = input_all (in);
+    if (size > WHOLE_INPUT_MAX)
+        return false;
+
+    const uint8_t *data = in->data + in->pos;
+    if (!g_dict && !g_inplace && (size >= ULZ_IX_HDR_SIZE) &&
+        (data [0] == ULZ_IX_MAGIC0) && (data [1] == ULZ_IX_MAGIC1) &&
+        (data [2] == ULZ_IX_MAGIC2) && (data [3] == ULZ_IX_MAGIC3))
+        return decompress_index (data, size, outf);
+
+    uint8_t *out;
+    unsigned out_size;
+    if (g_dict || g_inplace)
+    {
+        out = g_dict ?
+            decompress_dict (data, size, &out_size) :
+            decompress_inplace (data, size, &out_size);
+        // these formats don't keep flags, filter must be given again
+        if (out && g_thumb)
+            ulz_thumb_filter (out, out_size, 0, false);
+    }
+    else
+    {
+        // a bare uLZ block, as produced by older versions
+        out_size = ulz_decompress_size (data, size);
+        if (out_size > WHOLE_INPUT_MAX)
             return false;
+
+        out = malloc (out_size + 1);
+        if (!out)
+            return no_memory ();
+
+        if (!ulz_decompress (data, size, out, &out_size))
+        {
+            free (out);
+            out = NULL;
         }
     }
 
-    free (inf_buf);
+    if (!out)
+        return false;
+
+    bool ok = (fwrite (out, 1, out_size, outf) == out_size);
+    free (out);
+    return ok;
+}
+
+static bool process (const char *fn)
+{
+    bool from_stdin = (strcmp (fn, "-") == 0);
+    bool to_stdout = g_stdout || (g_ofn ? (strcmp (g_ofn, "-") == 0) : from_stdin);
+    // keep standard output clean when data goes there
+    FILE *msg = to_stdout ? stderr : stdout;
 
     if (g_verbose)
-        printf ("%.1f%%\n", (100.0 * outf_size) / inf_size);
+    {
+        fprintf (msg, "%s ... ", fn);
+        fflush (msg);
+    }
 
-    if (!g_overwrite)
+    const char *dot = strrchr (fn, '.');
+    if (!dot)
+        dot = strchr (fn, 0);
+
+    bool decompress = g_decompress;
+    if (!decompress && !from_stdin)
     {
-        inf = fopen (ofn, "r");
-        if (inf)
+        // auto-detect whether to compress or decompress
+        decompress = (strcmp (dot, ".ulz") == 0);
+    }
+
+    char ofn_buff [FILENAME_MAX + 1];
+    const char *ofn = to_stdout ? "-" : g_ofn ? g_ofn : ofn_buff;
+    if (decompress)
+        snprintf (ofn_buff, sizeof (ofn_buff), "%.*s", (int)(dot - fn), fn);
+    else
+        snprintf (ofn_buff, sizeof (ofn_buff), "%s.ulz", fn);
+
+    input_t in;
+    if (!input_open (&in, fn))
+    {
+        if (g_verbose)
+            fprintf (msg, "ERROR\n");
+        return false;
+    }
+
+    FILE *outf;
+    if (to_stdout)
+    {
+        if (!decompress && !g_overwrite && isatty (fileno (stdout)))
         {
-            fclose (inf);
+            input_close (&in);
+            fprintf (stderr, "%s: Won't write compressed data to a terminal, use -f to force\n",
+                     g_program);
+            return false;
+        }
+        outf = stdout;
+    }
+    else
+    {
+        if (!g_overwrite && (access (ofn, F_OK) == 0))
+        {
+            input_close (&in);
             fprintf (stderr, "%s: Output file '%s' already exist, use -f to overwrite\n",
                      g_program, ofn);
             return false;
         }
+
+        outf = fopen (ofn, "wb");
+        if (!outf)
+        {
+            input_close (&in);
+            fprintf (stderr, "%s: Can't open '%s' for writing!\n", g_program, ofn);
+            return false;
+        }
     }
 
-    FILE *outf = fopen (ofn, "wb");
-    if (!outf)
+    bool ok = decompress ? decompress_file (&in, outf) : compress_file (&in, outf);
+    // input cut short for the lack of memory has been reported already
+    ok = ok && !in.nomem;
+    bool read_error = in.f && ferror (in.f);
+    uint64_t inf_size = input_size (&in);
+    input_close (&in);
+
+    bool write_error = ferror (outf);
+    // position in a pipe or a shared output is meaningless
+    off_t outf_size = to_stdout ? -1 : ftello (outf);
+    if (to_stdout ? (fflush (outf) != 0) : (fclose (outf) != 0))
+        write_error = true;
+
+    if (!ok || read_error || write_error)
     {
-        free (outf_buf);
-        fprintf (stderr, "%s: Can't open '%s' for writing!\n", g_program, fn);
+        if (g_verbose)
+            fprintf (msg, decompress && !read_error && !write_error ? "broken\n" : "ERROR\n");
+        if (read_error)
+            fprintf (stderr, "%s: Can't read file '%s'\n", g_program, fn);
+        else if (write_error)
+            fprintf (stderr, "%s: Can't write to file '%s'\n", g_program, ofn);
+        else if (decompress)
+            fprintf (stderr, "%s: Packed file '%s' cannot be uncompressed\n",
+                     g_program, fn);
+        else
+            fprintf (stderr, "%s: Can't compress file '%s'\n", g_program, fn);
+        if (!to_stdout)
+            remove (ofn);
         return false;
     }
 
-    ulong bytes_written = fwrite (outf_buf, 1, outf_size, outf);
-    fclose (outf);
-    free (outf_buf);
+    if (g_remove && !from_stdin && (remove (fn) != 0))
+        fprintf (stderr, "%s: Can't remove file '%s'\n", g_program, fn);
 
-    if (bytes_written != outf_size)
+    if (g_verbose)
     {
-        fprintf (stderr, "%s: Can't write %u bytes to file '%s'\n",
-                 g_program, outf_size, ofn);
-        return false;
+        if (outf_size < 0)
+            fprintf (msg, "OK\n");
+        else
+            fprintf (msg, "%.1f%%\n", inf_size ? (100.0 * outf_size) / inf_size : 100.0);
     }
 
     return true;
@@ -202,15 +1360,83 @@ static void test_bitstreams ()
 }
 #endif
 
+/**
+ * Benchmark every file as a single block, or the synthetic corpus
+ * if no files given, with current compression settings.
+ */
+static bool run_bench (char *const *files, unsigned count)
+{
+    bench_opts_t opts =
+    {
+        .level = g_level | (g_repofs ? ULZ_FLAG_REPOFS : 0) |
+            (g_huff ? ULZ_FLAG_HUFF : 0) | (g_large ? ULZ_FLAG_LARGE : 0),
+        .workmem = g_workmem * 1024,
+        .fast = true,
+        .min_time = 500,
+        .fuzz = 1000,
+    };
+
+    if (count == 0)
+    {
+        bench_data_t corpus [BENCH_CORPUS_SIZE];
+        bool ok = (bench_corpus (corpus) || no_memory ()) &&
+            bench (corpus, BENCH_CORPUS_SIZE, &opts);
+        bench_corpus_free (corpus);
+        return ok;
+    }
+
+    bench_data_t *data = calloc (count, sizeof (bench_data_t));
+    if (!data)
+        return no_memory ();
+
+    bool ok = true;
+    for (unsigned i = 0; i < count; i++)
+    {
+        data [i].name = files [i];
+        data [i].data = load_file (files [i], &data [i].size);
+        if (!data [i].data)
+        {
+            ok = false;
+            break;
+        }
+    }
+
+    if (ok)
+        ok = bench (data, count, &opts);
+
+    for (unsigned i = 0; i < count; i++)
+        free (data [i].data);
+    free (data);
+    return ok;
+}
+
 int main (int argc, char *const *argv)
 {
     //test_bitstreams (); return 0;
 
     static struct option long_options [] =
     {
+        {"block", required_argument, 0, 'b'},
+        {"bench", no_argument, 0, 'B'},
+        {"window", required_argument, 0, 'w'},
+        {"stdout", no_argument, 0, 'c'},
+        {"keep", no_argument, 0, 'k'},
+        {"rm", no_argument, 0, 'R'},
         {"decompress", no_argument, 0, 'd'},
         {"force", no_argument, 0, 'f'},
+        {"index", no_argument, 0, 'i'},
+        {"level", required_argument, 0, 'l'},
+        {"memory", required_argument, 0, 'm'},
+        {"repeat", no_argument, 0, 'r'},
+        {"huffman", no_argument, 0, 'H'},
+        {"filter", required_argument, 0, 'F'},
         {"output", required_argument, 0, 'o'},
+        {"in-place", no_argument, 0, 'p'},
+        {"bare", no_argument, 0, 'A'},
+        {"dict", required_argument, 0, 'D'},
+        {"train", required_argument, 0, 't'},
+        {"dict-size", required_argument, 0, 's'},
+        {"threads", required_argument, 0, 'T'},
         {"verbose", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'V'},
@@ -220,29 +1446,157 @@ int main (int argc, char *const *argv)
     g_program = argv [0];
 
     int c;
-    while ((c = getopt_long (argc, argv, "dfo:vhV", long_options, 0)) != EOF)
+    while ((c = getopt_long (argc, argv, "b:BcdD:fF:Hikl:m:o:prs:t:T:vw:hV", long_options, 0)) != EOF)
         switch (c)
         {
             case '?':
                 // unknown option
                 return EXIT_FAILURE;
 
+            case 'b':
+                g_blk_log = strtoul (optarg, NULL, 0);
+                if ((g_blk_log < ULZ_FRAME_BLK_LOG_MIN) || (g_blk_log > ULZ_FRAME_BLK_LOG_MAX))
+                {
+                    fprintf (stderr, "%s: Invalid block size '%s'\n",
+                             g_program, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'B':
+                g_bench = true;
+                break;
+
+            case 'c':
+                g_stdout = true;
+                break;
+
             case 'd':
                 g_decompress = true;
                 break;
 
+            case 'D':
+                g_dict_fn = optarg;
+                break;
+
             case 'f':
                 g_overwrite = true;
                 break;
 
+            case 'F':
+                if (strcmp (optarg, "thumb") == 0)
+                    g_thumb = true;
+                else if (strcmp (optarg, "none") == 0)
+                    g_thumb = false;
+                else
+                {
+                    fprintf (stderr, "%s: Unknown filter '%s'\n",
+                             g_program, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'H':
+                g_huff = true;
+                break;
+
+            case 'i':
+                g_index = true;
+                break;
+
+            case 'k':
+                g_remove = false;
+                break;
+
+            case 'l':
+                g_level = strtoul (optarg, NULL, 0);
+                if (g_level > ULZ_LEVEL_OPTIMAL)
+                {
+                    fprintf (stderr, "%s: Invalid compression level '%s'\n",
+                             g_program, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'm':
+            {
+                unsigned long workmem = strtoul (optarg, NULL, 0);
+                g_workmem = workmem;
+                if ((workmem == 0) || (workmem > WORKMEM_MAX))
+                {
+                    fprintf (stderr, "%s: Invalid match finder memory size '%s'\n",
+                             g_program, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+
             case 'o':
                 g_ofn = optarg;
                 break;
 
+            case 'p':
+                g_inplace = true;
+                break;
+
+            case 'r':
+                g_repofs = true;
+                break;
+
+            case 'R':
+                g_remove = true;
+                break;
+
+            case 'A':
+                g_bare = true;
+                break;
+
+            case 's':
+                g_dict_size = strtoul (optarg, NULL, 0);
+                if (g_dict_size == 0)
+                {
+                    fprintf (stderr, "%s: Invalid dictionary size '%s'\n",
+                             g_program, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 't':
+                g_train_fn = optarg;
+                break;
+
+            case 'T':
+            {
+                unsigned long threads = strtoul (optarg, NULL, 0);
+                if (threads == 0)
+                {
+                    long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+                    threads = (ncpu > 0) ? MIN ((unsigned long)ncpu, THREADS_MAX) : 1;
+                }
+                g_threads = threads;
+                if (threads > THREADS_MAX)
+                {
+                    fprintf (stderr, "%s: Invalid number of threads '%s'\n",
+                             g_program, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+
             case 'v':
                 g_verbose++;
                 break;
 
+            case 'w':
+                g_win_log = strtoul (optarg, NULL, 0);
+                if (g_win_log > ULZ_FRAME_WIN_LOG_LARGE_MAX)
+                {
+                    fprintf (stderr, "%s: Invalid window size '%s'\n",
+                             g_program, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
             case 'h':
                 display_help ();
                 return EXIT_FAILURE;
@@ -256,15 +1610,69 @@ int main (int argc, char *const *argv)
                 abort ();
         }
 
-    if (optind >= argc)
+    if ((optind >= argc) && !g_bench)
     {
         display_help ();
         return EXIT_FAILURE;
     }
 
+    if (g_huff && g_repofs)
+    {
+        fprintf (stderr, "%s: Huffman literals and repeat offsets can't be used together\n",
+                 g_program);
+        return EXIT_FAILURE;
+    }
+
+    if (g_win_log && (g_repofs || g_index || g_inplace || g_dict_fn))
+    {
+        fprintf (stderr, "%s: History window is supported only by plain frames\n",
+                 g_program);
+        return EXIT_FAILURE;
+    }
+
+    // Match finder needs more memory to see that far
+    g_large = (g_win_log > ULZ_FRAME_WIN_LOG_MAX);
+    if (g_workmem == 0)
+        g_workmem = g_large ? MAX (4U << (g_win_log - 10), 4096U) : 4096;
+
+    if (g_bare && (g_index || g_inplace || g_dict_fn || g_win_log ||
+                   g_repofs || g_huff || g_thumb))
+    {
+        // ulz_decompress() knows nothing but the plain block format
+        fprintf (stderr, "%s: Bare blocks can't be combined with other formats and options\n",
+                 g_program);
+        return EXIT_FAILURE;
+    }
+
+    if (g_thumb && g_index)
+    {
+        // random access can't undo the filter in the middle of data
+        fprintf (stderr, "%s: Filters are not supported by indexed containers\n",
+                 g_program);
+        return EXIT_FAILURE;
+    }
+
+    if (g_bench)
+        return run_bench (argv + optind, argc - optind) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (g_train_fn)
+        return train_dict (argv + optind, argc - optind) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (g_dict_fn)
+    {
+        g_dict = load_file (g_dict_fn, &g_dict_size);
+        if (!g_dict)
+            return EXIT_FAILURE;
+    }
+
+    bool ok = true;
     for (; optind < argc; optind++)
         if (!process (argv [optind]))
-            return EXIT_FAILURE;
+        {
+            ok = false;
+            break;
+        }
 
-    return EXIT_SUCCESS;
+    free (g_dict);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -9,5 +9,6 @@ DESCRIPTION.ulz = Test the uLZ de/compression routines
 
 TARGETS.ulz = ulz$E
 SRC.ulz$E = $(wildcard tools/ulz/*.c)
-LIBS.ulz$E = useful$L
+LIBS.ulz$E = ulzbench$L useful$L
+LDFLAGS.ulz$E = -pthread
 endif